@@ -0,0 +1,316 @@
+#ifndef ASTEROID_BELT_H
+#define ASTEROID_BELT_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/bvh.h>
+#include <learnopengl/cpu_profiler.h>
+#include <learnopengl/frustum.h>
+#include <learnopengl/hiz_buffer.h>
+#include <learnopengl/model.h>
+#include <learnopengl/render_queue.h>
+#include <learnopengl/shader.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+using namespace std;
+
+// per instance data, matches the instanced attributes of asteroidBelt.vs
+struct AsteroidInstance {
+    glm::vec4 positionScale; // xyz: position in belt space, w: radius of the rock
+    glm::vec4 rotation;      // xyz: rotation axis * angular speed (radians/s), w: angle at time 0
+};
+
+// A ring of rocks around the belt's origin (in its xz plane), drawn with one instanced call per rock shape.
+//
+// The meshes of a prototype model are the rock shapes. Each one is re-centered and normalized to unit radius
+// in the vertex shader, so the instances only carry position, size and a spin; the rotation is animated on
+// the GPU from the time uniform. Since a rock never leaves the sphere given by its position and size, the
+// instances are frustum culled on the CPU, through a BVH over those spheres, and only the visible ones are
+// streamed to the GPU every frame.
+class AsteroidBelt
+{
+public:
+    struct Settings {
+        unsigned int count = 20000;
+        float radius = 70.0f;    // distance of the belt's center line from the origin
+        float width = 30.0f;     // radial extent
+        float thickness = 8.0f;  // extent along y
+        float minSize = 0.05f;   // radius of the rocks, small ones are more common
+        float maxSize = 0.6f;
+        float maxAngularSpeed = 1.0f;
+        unsigned int seed = 1;
+    };
+
+    // a range of instances drawn with one prototype mesh
+    struct Batch {
+        Mesh *mesh;
+        glm::vec4 prototype; // xyz: center of the mesh, w: 1 / its radius
+        size_t first;
+        size_t count;
+        // range in the visible instance buffer after the last Draw
+        size_t visibleFirst = 0;
+        size_t visibleCount = 0;
+    };
+
+    // prototypes has to outlive the belt, its mesh VAOs get the instance attributes
+    AsteroidBelt(Model &prototypes, const Settings &settings)
+    {
+        generate(prototypes, settings);
+        buildHierarchy();
+        setupInstanceBuffer();
+    }
+
+    // picks the instances to draw this frame and streams them to the GPU, once per frame before Draw/DrawDepth.
+    // frustum and occlusion are in belt space (projection * view * belt model), by default everything is drawn.
+    void Cull(const Frustum &frustum = Frustum(), CullingStats *stats = nullptr, const HiZBuffer::Test &occlusion = HiZBuffer::Test())
+    {
+        PROFILE_SCOPE("Asteroid cull");
+        size_t occluded = cull(frustum, occlusion);
+        if (stats) {
+            stats->instancesTested += instances.size();
+            stats->instancesDrawn += visibleInstances.size();
+            stats->instancesOccluded += occluded;
+        }
+        if (visibleInstances.empty())
+            return;
+        upload();
+        for (Batch &batch : batches)
+            if (batch.visibleCount > 0)
+                pointInstanceAttributes(batch);
+    }
+
+    // the shader (asteroidBelt.vs) has to be in use with the belt's model matrix set
+    void Draw(Shader &shader, float time)
+    {
+        draw(shader, time, false);
+    }
+
+    // depth only, the shader is asteroidBelt.vs with a fragment shader that writes no color
+    void DrawDepth(Shader &shader, float time)
+    {
+        draw(shader, time, true);
+    }
+
+    // adds the batches left by Cull to queue instead of drawing them. the time uniform is set right away,
+    // which leaves the shader in use.
+    void Queue(RenderQueue &queue, Shader &shader, float time, const glm::mat4 &model, UniformHandle modelUniform)
+    {
+        PROFILE_SCOPE("Asteroid queue");
+        if (visibleInstances.empty())
+            return;
+        const BeltUniforms &locations = uniformsOf(shader);
+        shader.use();
+        shader.setFloat(locations.time, time);
+        for (Batch &batch : batches) {
+            if (batch.visibleCount == 0)
+                continue;
+            DrawItem item;
+            item.shader = &shader;
+            item.mesh = batch.mesh;
+            item.instanceCount = batch.visibleCount;
+            item.model = &model;
+            item.modelUniform = modelUniform;
+            item.paramUniform = locations.prototype;
+            item.param = batch.prototype;
+            item.viewDepth = queue.ViewDepth(model, glm::vec3(0.0f));
+            queue.Add(item);
+        }
+    }
+
+    const vector<AsteroidInstance> &Instances() const
+    {
+        return instances;
+    }
+
+    const vector<Batch> &Batches() const
+    {
+        return batches;
+    }
+
+private:
+    vector<AsteroidInstance> instances;
+    vector<Batch> batches;
+    Bvh hierarchy;
+    vector<uint32_t> instanceBatch;
+    // per frame scratch, kept around to avoid allocations
+    vector<AsteroidInstance> visibleInstances;
+    vector<uint32_t> visibleIndices;
+    vector<size_t> batchCursor;
+    unsigned int instanceVBO = 0;
+    size_t instanceCapacity = 0;
+    // uniform locations per program the belt was drawn with
+    struct BeltUniforms {
+        unsigned int program;
+        UniformHandle prototype, time;
+    };
+    vector<BeltUniforms> uniforms;
+
+    void draw(Shader &shader, float time, bool depthOnly)
+    {
+        if (visibleInstances.empty())
+            return;
+        const BeltUniforms &locations = uniformsOf(shader);
+        shader.setFloat(locations.time, time);
+        for (Batch &batch : batches) {
+            if (batch.visibleCount == 0)
+                continue;
+            shader.setVec4(locations.prototype, batch.prototype);
+            if (depthOnly)
+                batch.mesh->DrawDepthInstanced(shader, batch.visibleCount);
+            else
+                batch.mesh->DrawInstanced(shader, batch.visibleCount);
+        }
+    }
+
+    const BeltUniforms &uniformsOf(const Shader &shader)
+    {
+        for (const BeltUniforms &locations : uniforms)
+            if (locations.program == shader.ID)
+                return locations;
+        uniforms.push_back({shader.ID, shader.uniform("prototype"), shader.uniform("time")});
+        return uniforms.back();
+    }
+
+    void generate(Model &prototypes, const Settings &settings)
+    {
+        const float pi = 3.14159265358979f;
+        mt19937 random(settings.seed);
+        uniform_real_distribution<float> unit(0.0f, 1.0f);
+        // sum of two uniforms: denser towards the middle of the belt
+        auto centered = [&] { return unit(random) + unit(random) - 1.0f; };
+
+        size_t shapes = prototypes.meshes.size();
+        if (shapes == 0)
+            return;
+        instances.reserve(settings.count);
+        for (size_t shape = 0; shape < shapes; shape++) {
+            Mesh &mesh = prototypes.meshes[shape];
+            glm::vec3 center = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+            float radius = std::max(glm::length(mesh.boundsMax - mesh.boundsMin) * 0.5f, 1e-6f);
+
+            Batch batch;
+            batch.mesh = &mesh;
+            batch.prototype = glm::vec4(center, 1.0f / radius);
+            batch.first = instances.size();
+            batch.count = settings.count / shapes + (shape < settings.count % shapes ? 1 : 0);
+
+            for (size_t i = 0; i < batch.count; i++) {
+                float angle = unit(random) * 2.0f * pi;
+                float distance = settings.radius + centered() * settings.width * 0.5f;
+                float height = centered() * settings.thickness * 0.5f;
+                float size = settings.minSize * std::pow(settings.maxSize / settings.minSize, unit(random) * unit(random));
+
+                // random axis, uniform on the sphere
+                float z = unit(random) * 2.0f - 1.0f;
+                float phi = unit(random) * 2.0f * pi;
+                float r = std::sqrt(1.0f - z * z);
+                glm::vec3 axis(r * std::cos(phi), r * std::sin(phi), z);
+
+                AsteroidInstance instance;
+                instance.positionScale = glm::vec4(std::cos(angle) * distance, height, std::sin(angle) * distance, size);
+                instance.rotation = glm::vec4(axis * (unit(random) * settings.maxAngularSpeed), unit(random) * 2.0f * pi);
+                instances.push_back(instance);
+            }
+            batches.push_back(batch);
+        }
+    }
+
+    // the rocks never move, so the tree is built once
+    void buildHierarchy()
+    {
+        vector<Aabb> boxes;
+        boxes.reserve(instances.size());
+        instanceBatch.resize(instances.size());
+        for (uint32_t b = 0; b < batches.size(); b++) {
+            for (size_t i = batches[b].first; i < batches[b].first + batches[b].count; i++) {
+                glm::vec3 center = glm::vec3(instances[i].positionScale);
+                float radius = instances[i].positionScale.w;
+                boxes.push_back(Aabb(center - glm::vec3(radius), center + glm::vec3(radius)));
+                instanceBatch[i] = b;
+            }
+        }
+        hierarchy.Build(boxes);
+    }
+
+    void setupInstanceBuffer()
+    {
+        glGenBuffers(1, &instanceVBO);
+        for (Batch &batch : batches) {
+            for (unsigned int vao : {batch.mesh->VAO, batch.mesh->depthVAO}) {
+                glBindVertexArray(vao);
+                glEnableVertexAttribArray(5);
+                glVertexAttribDivisor(5, 1);
+                glEnableVertexAttribArray(6);
+                glVertexAttribDivisor(6, 1);
+            }
+        }
+        glBindVertexArray(0);
+        visibleInstances.reserve(instances.size());
+        visibleIndices.resize(instances.size());
+    }
+
+    // gathers the visible instances of every batch into one contiguous array, returns how many were occluded
+    size_t cull(const Frustum &frustum, const HiZBuffer::Test &occlusion)
+    {
+        // the tree tests boxes around the spheres, the sphere test is exact for those it isn't sure about
+        size_t visible = 0, occluded = 0;
+        for (Batch &batch : batches)
+            batch.visibleCount = 0;
+        hierarchy.QueryFrustum(frustum, [&](uint32_t instance, bool inside) {
+            const glm::vec4 &sphere = instances[instance].positionScale;
+            if (!inside && !frustum.SphereVisible(glm::vec3(sphere), sphere.w))
+                return;
+            if (!occlusion.SphereVisible(glm::vec3(sphere), sphere.w)) {
+                occluded++;
+                return;
+            }
+            visibleIndices[visible++] = instance;
+            batches[instanceBatch[instance]].visibleCount++;
+        });
+
+        // counting sort by batch
+        size_t first = 0;
+        for (Batch &batch : batches) {
+            batch.visibleFirst = first;
+            first += batch.visibleCount;
+        }
+        visibleInstances.resize(visible);
+        batchCursor.resize(batches.size());
+        for (size_t b = 0; b < batches.size(); b++)
+            batchCursor[b] = batches[b].visibleFirst;
+        for (size_t i = 0; i < visible; i++)
+            visibleInstances[batchCursor[instanceBatch[visibleIndices[i]]]++] = instances[visibleIndices[i]];
+        return occluded;
+    }
+
+    void upload()
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        if (visibleInstances.size() > instanceCapacity)
+            instanceCapacity = instances.size(); // never more than everything
+        glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(AsteroidInstance), nullptr, GL_STREAM_DRAW); // orphan
+        glBufferSubData(GL_ARRAY_BUFFER, 0, visibleInstances.size() * sizeof(AsteroidInstance), visibleInstances.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // no base instance in GL 3.3: the shape's VAOs point straight at its range of the buffer
+    void pointInstanceAttributes(const Batch &batch)
+    {
+        size_t offset = batch.visibleFirst * sizeof(AsteroidInstance);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        for (unsigned int vao : {batch.mesh->VAO, batch.mesh->depthVAO}) {
+            glBindVertexArray(vao);
+            glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(AsteroidInstance), (void*)(offset + offsetof(AsteroidInstance, positionScale)));
+            glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(AsteroidInstance), (void*)(offset + offsetof(AsteroidInstance, rotation)));
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+};
+#endif
@@ -0,0 +1,281 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// what the command line asked for: a `--bench` run, and recording or replaying a camera track (camera_track.h)
+struct BenchmarkOptions {
+    bool enabled = false;
+    unsigned int frames = 1500;       // measured frames
+    unsigned int warmupFrames = 120;  // drawn first and not measured: shader compiles, texture uploads, pools filling
+    std::string output = "benchmark.json";
+    std::string recordPath;           // saves the session's camera track here on exit
+    std::string replayPath;           // drives the camera from this track, the benchmark too
+    std::string tracePath;            // writes the CPU profiling scopes here on exit (cpu_profiler.h)
+    bool floatVertices = false;       // uploads the meshes as float Vertex instead of the packed format, to compare
+};
+
+// --bench [--bench-frames N] [--bench-warmup N] [--bench-out file] [--record file | --replay file] [--trace file]
+// [--float-vertices].
+// false with a message for anything else.
+inline bool ParseBenchmarkOptions(int argc, char **argv, BenchmarkOptions &options)
+{
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--bench") == 0) {
+            options.enabled = true;
+        } else if (strcmp(argv[i], "--bench-frames") == 0 && hasValue) {
+            options.frames = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--bench-warmup") == 0 && hasValue) {
+            options.warmupFrames = std::max(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--bench-out") == 0 && hasValue) {
+            options.output = argv[++i];
+        } else if (strcmp(argv[i], "--record") == 0 && hasValue) {
+            options.recordPath = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && hasValue) {
+            options.replayPath = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0 && hasValue) {
+            options.tracePath = argv[++i];
+        } else if (strcmp(argv[i], "--float-vertices") == 0) {
+            options.floatVertices = true;
+        } else {
+            std::cout << "Unknown argument " << argv[i] << std::endl
+                      << "usage: " << argv[0] << " [--bench [--bench-frames N] [--bench-warmup N] [--bench-out file]]"
+                      << " [--record file | --replay file] [--trace file] [--float-vertices]" << std::endl;
+            return false;
+        }
+    }
+    if (!options.recordPath.empty() && !options.replayPath.empty()) {
+        std::cout << "--record and --replay can't be used together" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// A closed Catmull-Rom spline through control points, walked at a constant rate of control points per second.
+// Sample() gives the position at a time and the point a little further along, to look at: the camera faces
+// where it flies.
+class CameraPath
+{
+public:
+    CameraPath(std::vector<glm::vec3> points, float secondsPerPoint) : points(std::move(points)), secondsPerPoint(secondsPerPoint)
+    {
+    }
+
+    // seconds for one lap
+    float Duration() const
+    {
+        return points.size() * secondsPerPoint;
+    }
+
+    void Sample(float seconds, glm::vec3 &position, glm::vec3 &target) const
+    {
+        float t = seconds / secondsPerPoint;
+        position = at(t);
+        target = at(t + 0.25f);
+    }
+
+private:
+    std::vector<glm::vec3> points;
+    float secondsPerPoint;
+
+    // t in control points, wraps around
+    glm::vec3 at(float t) const
+    {
+        int count = (int) points.size();
+        float segment = std::floor(t);
+        float f = t - segment;
+        int i = ((int) segment % count + count) % count;
+        const glm::vec3 &p0 = points[(i + count - 1) % count];
+        const glm::vec3 &p1 = points[i];
+        const glm::vec3 &p2 = points[(i + 1) % count];
+        const glm::vec3 &p3 = points[(i + 2) % count];
+        return 0.5f * (2.0f * p1 + (p2 - p0) * f + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * f * f +
+                       (3.0f * p1 - p0 - 3.0f * p2 + p3) * f * f * f);
+    }
+};
+
+// Times the frames of a benchmark run and writes their statistics as JSON.
+//
+// The CPU time of a frame is the wall clock from BeginFrame to EndFrame, the time it takes to issue the frame.
+// The GPU time comes from timestamp queries around the same commands; their results are read QUERY_COUNT
+// frames later so the measuring doesn't make the CPU wait for the GPU, and Finish() collects the last ones.
+// The first warmupFrames frames are drawn but not counted.
+class Benchmark
+{
+public:
+    static const unsigned int QUERY_COUNT = 8;
+
+    struct Percentiles {
+        double mean = 0.0, p50 = 0.0, p95 = 0.0, p99 = 0.0, max = 0.0;
+    };
+
+    explicit Benchmark(const BenchmarkOptions &options) : options(options)
+    {
+        for (Slot &slot : slots)
+            glGenQueries(2, slot.queries);
+        cpuMilliseconds.reserve(options.frames);
+        gpuMilliseconds.reserve(options.frames);
+    }
+
+    ~Benchmark()
+    {
+        for (Slot &slot : slots)
+            glDeleteQueries(2, slot.queries);
+    }
+
+    Benchmark(const Benchmark &) = delete;
+    Benchmark &operator=(const Benchmark &) = delete;
+
+    // frames begun so far, warmup included
+    unsigned int Frame() const
+    {
+        return frame;
+    }
+
+    bool Finished() const
+    {
+        return frame >= options.warmupFrames + options.frames;
+    }
+
+    void BeginFrame()
+    {
+        Slot &slot = slots[frame % QUERY_COUNT];
+        // only if the GPU is QUERY_COUNT frames behind, the driver rarely lets it get that far
+        if (slot.pending)
+            collect(slot);
+        glQueryCounter(slot.queries[0], GL_TIMESTAMP);
+        frameStart = Clock::now();
+    }
+
+    // after the last GL command of the frame, before swapping
+    void EndFrame()
+    {
+        double cpu = std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count();
+        Slot &slot = slots[frame % QUERY_COUNT];
+        glQueryCounter(slot.queries[1], GL_TIMESTAMP);
+        slot.pending = frame >= options.warmupFrames;
+        if (slot.pending)
+            cpuMilliseconds.push_back(cpu);
+        frame++;
+    }
+
+    // waits for the outstanding GPU times
+    void Finish()
+    {
+        for (unsigned int i = 0; i < QUERY_COUNT; i++) {
+            Slot &slot = slots[(frame + i) % QUERY_COUNT];
+            if (slot.pending)
+                collect(slot);
+        }
+    }
+
+    static Percentiles Compute(std::vector<double> samples)
+    {
+        Percentiles result;
+        if (samples.empty())
+            return result;
+        std::sort(samples.begin(), samples.end());
+        // nearest rank
+        auto percentile = [&samples](double p) {
+            size_t rank = (size_t) std::ceil(p / 100.0 * samples.size());
+            return samples[std::max<size_t>(rank, 1) - 1];
+        };
+        for (double sample : samples)
+            result.mean += sample;
+        result.mean /= samples.size();
+        result.p50 = percentile(50.0);
+        result.p95 = percentile(95.0);
+        result.p99 = percentile(99.0);
+        result.max = samples.back();
+        return result;
+    }
+
+    // writes the statistics and the GL implementation they were taken on to options.output, prints a summary
+    bool WriteResults(int width, int height) const
+    {
+        Percentiles cpu = Compute(cpuMilliseconds), gpu = Compute(gpuMilliseconds);
+        std::ofstream out(options.output);
+        if (!out) {
+            std::cout << "Failed to write benchmark results to " << options.output << std::endl;
+            return false;
+        }
+        out << "{\n"
+            << "  \"renderer\": \"" << glString(GL_RENDERER) << "\",\n"
+            << "  \"vendor\": \"" << glString(GL_VENDOR) << "\",\n"
+            << "  \"version\": \"" << glString(GL_VERSION) << "\",\n"
+            << "  \"width\": " << width << ",\n"
+            << "  \"height\": " << height << ",\n"
+            << "  \"warmupFrames\": " << options.warmupFrames << ",\n"
+            << "  \"frames\": " << cpuMilliseconds.size() << ",\n"
+            << "  \"cpuMilliseconds\": " << json(cpu) << ",\n"
+            << "  \"gpuMilliseconds\": " << json(gpu) << "\n"
+            << "}\n";
+        std::cout << "Benchmark: " << cpuMilliseconds.size() << " frames at " << width << "x" << height
+                  << ", cpu p50 " << cpu.p50 << " ms p95 " << cpu.p95 << " ms p99 " << cpu.p99
+                  << " ms, gpu p50 " << gpu.p50 << " ms p95 " << gpu.p95 << " ms p99 " << gpu.p99
+                  << " ms, written to " << options.output << std::endl;
+        return true;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Slot {
+        unsigned int queries[2] = {0, 0};
+        bool pending = false;
+    };
+
+    BenchmarkOptions options;
+    Slot slots[QUERY_COUNT];
+    unsigned int frame = 0;
+    Clock::time_point frameStart;
+    std::vector<double> cpuMilliseconds;
+    std::vector<double> gpuMilliseconds;
+
+    // blocks until the slot's result is there
+    void collect(Slot &slot)
+    {
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(slot.queries[0], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(slot.queries[1], GL_QUERY_RESULT, &end);
+        gpuMilliseconds.push_back((end - begin) / 1000000.0);
+        slot.pending = false;
+    }
+
+    static std::string json(const Percentiles &p)
+    {
+        char text[200];
+        snprintf(text, sizeof(text), "{\"mean\": %.3f, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f}",
+                 p.mean, p.p50, p.p95, p.p99, p.max);
+        return text;
+    }
+
+    // a GL string escaped for a JSON string
+    static std::string glString(GLenum name)
+    {
+        const char *value = (const char *) glGetString(name);
+        std::string escaped;
+        for (const char *c = value ? value : ""; *c; c++) {
+            if (*c == '"' || *c == '\\')
+                escaped += '\\';
+            if ((unsigned char) *c >= 0x20)
+                escaped += *c;
+        }
+        return escaped;
+    }
+};
+#endif
@@ -0,0 +1,111 @@
+#ifndef BILLBOARD_RENDERER_H
+#define BILLBOARD_RENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/cpu_profiler.h>
+#include <learnopengl/shader.h>
+
+#include <cstddef>
+#include <vector>
+using namespace std;
+
+// one textured quad, the quad spans [-1, 1] in x and y of the model space
+struct BillboardInstance {
+    glm::mat4 model;
+    glm::vec4 color = glm::vec4(1.0f); // multiplied with the texture
+};
+
+// Draws any number of textured quads with a single instanced draw call.
+// Instance data is streamed into a buffer that is orphaned every frame and grows as needed, so the cost
+// per sprite is one BillboardInstance copy. Expects a shader like lightShader.vs, with the quad in
+// attributes 0-2, the model matrix in 3-6 and the color in 7.
+class BillboardRenderer
+{
+public:
+    unsigned int VAO;
+
+    explicit BillboardRenderer(size_t initialCapacity = 64)
+    {
+        static const float quadVertices[] = {
+                // positions          // normals         // texture coords
+                1.0f, 1.0f, 0.0f,    0.0f, 0.0f, 1.0f,  1.0f, 1.0f, // top right
+                1.0f, -1.0f, 0.0f,   0.0f, 0.0f, 1.0f,  1.0f, 0.0f, // bottom right
+                -1.0f, -1.0f, 0.0f,  0.0f, 0.0f, 1.0f,  0.0f, 0.0f, // bottom left
+                -1.0f, 1.0f, 0.0f,   0.0f, 0.0f, 1.0f,  0.0f, 1.0f  // top left
+        };
+        static const unsigned int quadIndices[] = {
+                0, 1, 3,
+                1, 2, 3
+        };
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &quadVBO);
+        glGenBuffers(1, &EBO);
+        glGenBuffers(1, &instanceVBO);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), quadVertices, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(quadIndices), quadIndices, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+
+        // per instance: a mat4 takes four vec4 attribute slots
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        for (unsigned int column = 0; column < 4; column++) {
+            glEnableVertexAttribArray(3 + column);
+            glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(BillboardInstance),
+                                  (void*)(offsetof(BillboardInstance, model) + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(3 + column, 1);
+        }
+        glEnableVertexAttribArray(7);
+        glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(BillboardInstance), (void*)offsetof(BillboardInstance, color));
+        glVertexAttribDivisor(7, 1);
+        glBindVertexArray(0);
+
+        reserve(initialCapacity);
+    }
+
+    // draws all instances, the shader has to be in use and its textures bound
+    void Draw(const BillboardInstance *instances, size_t count)
+    {
+        PROFILE_SCOPE("Billboards");
+        if (count == 0)
+            return;
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        if (count > capacity)
+            reserve(count + count / 2);
+        else
+            glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(BillboardInstance), nullptr, GL_STREAM_DRAW); // orphan
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(BillboardInstance), instances);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glBindVertexArray(VAO);
+        glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr, count);
+        glBindVertexArray(0);
+    }
+
+    void Draw(const vector<BillboardInstance> &instances)
+    {
+        Draw(instances.data(), instances.size());
+    }
+
+private:
+    unsigned int quadVBO, EBO, instanceVBO;
+    size_t capacity = 0;
+
+    void reserve(size_t instanceCount)
+    {
+        capacity = instanceCount;
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(BillboardInstance), nullptr, GL_STREAM_DRAW);
+    }
+};
+#endif
@@ -0,0 +1,131 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/cpu_profiler.h>
+#include <learnopengl/render_targets.h>
+#include <learnopengl/shader.h>
+
+#include <algorithm>
+#include <iostream>
+using namespace std;
+
+// Bloom over a mip chain, as in "Next Generation Post Processing in Call of Duty: Advanced Warfare".
+//
+// The bright parts of the frame are downsampled level by level, starting at half resolution, each step
+// filtering 13 taps; the first step weights its taps by 1 / (1 + luma) so a single hot pixel can't make the
+// glow flicker. Then the chain is walked back up, every level adding a tent filtered copy of the smaller
+// one onto itself. Level 0 ends up with the sum of all of them: a wide, smooth glow for a handful of passes
+// at a quarter of the frame's pixels and less, where the old separable blur ran ten passes at full size.
+// The levels are transient render targets, sized after the frame every time.
+class Bloom
+{
+public:
+    static const unsigned int MAX_LEVELS = 8;
+
+    struct Settings {
+        unsigned int levels = 6;  // passes down (and up) the chain, fewer if the frame is too small
+        float filterRadius = 1.0f; // of the upsampling tent, in texels of the smaller level
+    };
+
+    Bloom()
+    {
+        glGenFramebuffers(1, &FBO);
+        glGenVertexArrays(1, &emptyVAO);
+    }
+
+    ~Bloom()
+    {
+        glDeleteFramebuffers(1, &FBO);
+        glDeleteVertexArrays(1, &emptyVAO);
+    }
+
+    Bloom(const Bloom &) = delete;
+    Bloom &operator=(const Bloom &) = delete;
+
+    const Settings &GetSettings() const
+    {
+        return settings;
+    }
+
+    void SetSettings(Settings changed)
+    {
+        changed.levels = std::max(1u, std::min(changed.levels, (unsigned int) MAX_LEVELS));
+        settings = changed;
+    }
+
+    // blurs sourceTexture (the frame's bright parts, a full size target drawn up to targets.RenderSize()) and
+    // returns the texture to sample, the full chain's sum covering the drawn part. It is acquired from
+    // targets, Release it after use.
+    // downsampleShader is fullScreen.vs + bloomDownsample.fs, upsampleShader fullScreen.vs + bloomUpsample.fs.
+    // Leaves framebuffer 0 bound.
+    unsigned int Render(RenderTargets &targets, Shader &downsampleShader, Shader &upsampleShader, unsigned int sourceTexture)
+    {
+        PROFILE_SCOPE("Bloom");
+        const TargetFormat format = {GL_R11F_G11F_B10F, GL_RGB, GL_FLOAT, GL_LINEAR};
+        glm::ivec2 baseSize(std::max(1, targets.RenderSize().x / 2), std::max(1, targets.RenderSize().y / 2));
+        unsigned int levels = 1;
+        while (levels < settings.levels && (baseSize.x >> levels > 0 || baseSize.y >> levels > 0))
+            levels++;
+        unsigned int textures[MAX_LEVELS];
+        glm::ivec2 sizes[MAX_LEVELS];
+        for (unsigned int level = 0; level < levels; level++) {
+            sizes[level] = glm::ivec2(std::max(1, baseSize.x >> level), std::max(1, baseSize.y >> level));
+            textures[level] = targets.Acquire(format, sizes[level]);
+        }
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+        glDisable(GL_DEPTH_TEST);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glBindVertexArray(emptyVAO);
+        glActiveTexture(GL_TEXTURE0);
+
+        downsampleShader.use();
+        downsampleShader.setInt("source", 0);
+        for (unsigned int level = 0; level < levels; level++) {
+            bindTarget(textures[level], sizes[level]);
+            downsampleShader.setBool("karisAverage", level == 0);
+            downsampleShader.setVec2("uvScale", level == 0 ? targets.UVScale() : glm::vec2(1.0f));
+            glBindTexture(GL_TEXTURE_2D, level == 0 ? sourceTexture : textures[level - 1]);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+
+        upsampleShader.use();
+        upsampleShader.setInt("source", 0);
+        upsampleShader.setFloat("filterRadius", settings.filterRadius);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        for (unsigned int level = levels - 1; level > 0; level--) {
+            bindTarget(textures[level - 1], sizes[level - 1]);
+            glBindTexture(GL_TEXTURE_2D, textures[level]);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        glDisable(GL_BLEND);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        for (unsigned int level = 1; level < levels; level++)
+            targets.Release(textures[level]);
+
+        glBindVertexArray(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        if (depthTest)
+            glEnable(GL_DEPTH_TEST);
+        return textures[0];
+    }
+
+private:
+    Settings settings;
+    unsigned int FBO, emptyVAO;
+
+    // expects FBO bound
+    static void bindTarget(unsigned int texture, glm::ivec2 size)
+    {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        glViewport(0, 0, size.x, size.y);
+    }
+};
+#endif
@@ -0,0 +1,388 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/frustum.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+// axis aligned bounding box, empty (inverted) by default
+struct Aabb {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    Aabb() = default;
+    Aabb(const glm::vec3 &min, const glm::vec3 &max) : min(min), max(max) {}
+
+    void grow(const glm::vec3 &point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void grow(const Aabb &box)
+    {
+        min = glm::min(min, box.min);
+        max = glm::max(max, box.max);
+    }
+
+    glm::vec3 center() const
+    {
+        return (min + max) * 0.5f;
+    }
+
+    // half the surface area, all the SAH needs
+    float area() const
+    {
+        glm::vec3 size = max - min;
+        return size.x < 0.0f ? 0.0f : size.x * size.y + size.y * size.z + size.z * size.x;
+    }
+
+    bool operator==(const Aabb &other) const
+    {
+        return min == other.min && max == other.max;
+    }
+
+    // bounds of the box after transforming it (Arvo's method, no corner loop)
+    static Aabb Transform(const Aabb &box, const glm::mat4 &m)
+    {
+        glm::vec3 translation = glm::vec3(m[3]);
+        Aabb result(translation, translation);
+        for (int column = 0; column < 3; column++) {
+            glm::vec3 axis = glm::vec3(m[column]);
+            glm::vec3 a = axis * box.min[column];
+            glm::vec3 b = axis * box.max[column];
+            result.min += glm::min(a, b);
+            result.max += glm::max(a, b);
+        }
+        return result;
+    }
+};
+
+// Bounding volume hierarchy over a fixed set of objects, each given by its AABB.
+//
+// Built top down with a binned surface area heuristic. Objects can move afterwards: Update refits the boxes
+// on the path from the object's leaf to the root, which keeps queries correct (the tree just gets looser,
+// call Build again after large changes). Queries cost O(log n + results) instead of a loop over everything.
+class Bvh
+{
+public:
+    static const uint32_t MAX_LEAF_SIZE = 4;
+    // deeper nodes become leaves whatever their size, which bounds the query stacks: a depth first walk
+    // holds at most one entry per level plus one
+    static const uint32_t MAX_DEPTH = 48;
+    static const int STACK_SIZE = 64;
+
+    struct RayHit {
+        uint32_t object = ~0u;
+        float distance = FLT_MAX;
+    };
+
+    void Build(const vector<Aabb> &boxes)
+    {
+        objectBounds = boxes;
+        objectIndices.resize(boxes.size());
+        objectLeaf.assign(boxes.size(), 0);
+        for (uint32_t i = 0; i < boxes.size(); i++)
+            objectIndices[i] = i;
+        nodes.clear();
+        if (boxes.empty())
+            return;
+        nodes.reserve(2 * boxes.size() / MAX_LEAF_SIZE + 2);
+        nodes.push_back(Node());
+        nodes[0].parent = ~0u;
+        subdivide(0, 0, boxes.size(), 0);
+    }
+
+    // moves an object, refitting only the nodes above it
+    void Update(uint32_t object, const Aabb &box)
+    {
+        objectBounds[object] = box;
+        uint32_t nodeIndex = objectLeaf[object];
+        while (nodeIndex != ~0u) {
+            Node &node = nodes[nodeIndex];
+            Aabb bounds;
+            if (node.count > 0) {
+                for (uint32_t i = node.first; i < node.first + node.count; i++)
+                    bounds.grow(objectBounds[objectIndices[i]]);
+            } else {
+                bounds = nodes[node.first].bounds;
+                bounds.grow(nodes[node.first + 1].bounds);
+            }
+            if (bounds == node.bounds)
+                break; // nothing above changes either
+            node.bounds = bounds;
+            nodeIndex = node.parent;
+        }
+    }
+
+    // calls visit(object, inside) for every object whose box intersects the frustum. inside is true when the
+    // whole box is known to be in the frustum; otherwise only the box was tested, callers can refine.
+    template<typename Visit>
+    void QueryFrustum(const Frustum &frustum, Visit &&visit) const
+    {
+        if (nodes.empty())
+            return;
+        struct Entry { uint32_t node; bool inside; };
+        Entry stack[STACK_SIZE];
+        int top = 0;
+        stack[top++] = {0, false};
+        while (top > 0) {
+            Entry entry = stack[--top];
+            const Node &node = nodes[entry.node];
+            bool inside = entry.inside;
+            if (!inside) {
+                Frustum::Result result = frustum.ClassifyBox(node.bounds.min, node.bounds.max);
+                if (result == Frustum::OUTSIDE)
+                    continue;
+                inside = result == Frustum::INSIDE;
+            }
+            if (node.count > 0) {
+                for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                    uint32_t object = objectIndices[i];
+                    if (inside)
+                        visit(object, true);
+                    else if (frustum.BoxVisible(objectBounds[object].min, objectBounds[object].max))
+                        visit(object, false);
+                }
+            } else {
+                stack[top++] = {node.first, inside};
+                stack[top++] = {node.first + 1, inside};
+            }
+        }
+    }
+
+    // calls visit(object) for every object whose box is closer than radius to center
+    template<typename Visit>
+    void QuerySphere(const glm::vec3 &center, float radius, Visit &&visit) const
+    {
+        if (nodes.empty())
+            return;
+        float radiusSquared = radius * radius;
+        uint32_t stack[STACK_SIZE];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node &node = nodes[stack[--top]];
+            if (distanceSquared(node.bounds, center) > radiusSquared)
+                continue;
+            if (node.count > 0) {
+                for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                    uint32_t object = objectIndices[i];
+                    if (distanceSquared(objectBounds[object], center) <= radiusSquared)
+                        visit(object);
+                }
+            } else {
+                stack[top++] = node.first;
+                stack[top++] = node.first + 1;
+            }
+        }
+    }
+
+    // nearest object hit by the ray. intersect(object, maxDistance) returns the exact hit distance of an
+    // object whose box the ray enters, or a negative value for a miss. direction doesn't have to be normalized,
+    // distances are in multiples of it.
+    template<typename Intersect>
+    bool Raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, Intersect &&intersect, RayHit &hit) const
+    {
+        hit = RayHit();
+        hit.distance = maxDistance;
+        if (nodes.empty())
+            return false;
+        glm::vec3 inverse = glm::vec3(1.0f) / direction;
+        uint32_t stack[STACK_SIZE];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node &node = nodes[stack[--top]];
+            if (rayBox(node.bounds, origin, inverse, hit.distance) < 0.0f)
+                continue;
+            if (node.count > 0) {
+                for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                    uint32_t object = objectIndices[i];
+                    if (rayBox(objectBounds[object], origin, inverse, hit.distance) < 0.0f)
+                        continue;
+                    float distance = intersect(object, hit.distance);
+                    if (distance >= 0.0f && distance < hit.distance) {
+                        hit.distance = distance;
+                        hit.object = object;
+                    }
+                }
+            } else {
+                // visit the nearer child first, so the farther one is more likely to be pruned
+                float left = rayBox(nodes[node.first].bounds, origin, inverse, hit.distance);
+                float right = rayBox(nodes[node.first + 1].bounds, origin, inverse, hit.distance);
+                if (left >= 0.0f && right >= 0.0f) {
+                    stack[top++] = left < right ? node.first + 1 : node.first;
+                    stack[top++] = left < right ? node.first : node.first + 1;
+                } else if (left >= 0.0f) {
+                    stack[top++] = node.first;
+                } else if (right >= 0.0f) {
+                    stack[top++] = node.first + 1;
+                }
+            }
+        }
+        return hit.object != ~0u;
+    }
+
+    // nearest object box hit by the ray
+    bool Raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, RayHit &hit) const
+    {
+        glm::vec3 inverse = glm::vec3(1.0f) / direction;
+        return Raycast(origin, direction, maxDistance, [&](uint32_t object, float) {
+            return rayBox(objectBounds[object], origin, inverse, FLT_MAX);
+        }, hit);
+    }
+
+    const Aabb &Bounds(uint32_t object) const
+    {
+        return objectBounds[object];
+    }
+
+    size_t ObjectCount() const
+    {
+        return objectBounds.size();
+    }
+
+    size_t NodeCount() const
+    {
+        return nodes.size();
+    }
+
+    // entry distance of the ray into the box, negative if it misses or enters beyond maxDistance
+    static float rayBox(const Aabb &box, const glm::vec3 &origin, const glm::vec3 &inverseDirection, float maxDistance)
+    {
+        glm::vec3 t0 = (box.min - origin) * inverseDirection;
+        glm::vec3 t1 = (box.max - origin) * inverseDirection;
+        glm::vec3 near = glm::min(t0, t1);
+        glm::vec3 far = glm::max(t0, t1);
+        float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+        float exit = std::min(std::min(far.x, far.y), std::min(far.z, maxDistance));
+        return enter <= exit ? enter : -1.0f;
+    }
+
+private:
+    // inner nodes (count == 0) have their children at first and first + 1,
+    // leaves own objectIndices[first, first + count)
+    struct Node {
+        Aabb bounds;
+        uint32_t first = 0;
+        uint32_t count = 0;
+        uint32_t parent = 0;
+    };
+
+    static const int BIN_COUNT = 12;
+
+    vector<Node> nodes;
+    vector<uint32_t> objectIndices;
+    vector<Aabb> objectBounds;
+    vector<uint32_t> objectLeaf;
+
+    static float distanceSquared(const Aabb &box, const glm::vec3 &point)
+    {
+        glm::vec3 offset = glm::max(glm::max(box.min - point, point - box.max), glm::vec3(0.0f));
+        return glm::dot(offset, offset);
+    }
+
+    void makeLeaf(uint32_t nodeIndex, uint32_t begin, uint32_t end)
+    {
+        nodes[nodeIndex].first = begin;
+        nodes[nodeIndex].count = end - begin;
+        for (uint32_t i = begin; i < end; i++)
+            objectLeaf[objectIndices[i]] = nodeIndex;
+    }
+
+    static_assert(MAX_DEPTH + 1 <= (uint32_t) STACK_SIZE, "the query stacks have to hold a path from the root");
+
+    void subdivide(uint32_t nodeIndex, uint32_t begin, uint32_t end, uint32_t depth)
+    {
+        Aabb bounds, centroids;
+        for (uint32_t i = begin; i < end; i++) {
+            bounds.grow(objectBounds[objectIndices[i]]);
+            centroids.grow(objectBounds[objectIndices[i]].center());
+        }
+        nodes[nodeIndex].bounds = bounds;
+        uint32_t count = end - begin;
+        if (count <= 2 || depth == MAX_DEPTH) {
+            makeLeaf(nodeIndex, begin, end);
+            return;
+        }
+
+        // binned SAH over all three axes
+        int bestAxis = -1;
+        int bestSplit = 0;
+        float bestCost = FLT_MAX;
+        glm::vec3 extent = centroids.max - centroids.min;
+        for (int axis = 0; axis < 3; axis++) {
+            if (extent[axis] <= 0.0f)
+                continue;
+            Aabb binBounds[BIN_COUNT];
+            uint32_t binCount[BIN_COUNT] = {0};
+            float scale = BIN_COUNT / extent[axis];
+            for (uint32_t i = begin; i < end; i++) {
+                const Aabb &box = objectBounds[objectIndices[i]];
+                int bin = std::min(BIN_COUNT - 1, (int) ((box.center()[axis] - centroids.min[axis]) * scale));
+                binCount[bin]++;
+                binBounds[bin].grow(box);
+            }
+            // sweep from the right, then from the left evaluating every split
+            float rightArea[BIN_COUNT];
+            uint32_t rightCount[BIN_COUNT];
+            Aabb accumulated;
+            uint32_t accumulatedCount = 0;
+            for (int bin = BIN_COUNT - 1; bin > 0; bin--) {
+                accumulated.grow(binBounds[bin]);
+                accumulatedCount += binCount[bin];
+                rightArea[bin] = accumulated.area();
+                rightCount[bin] = accumulatedCount;
+            }
+            accumulated = Aabb();
+            accumulatedCount = 0;
+            for (int split = 1; split < BIN_COUNT; split++) {
+                accumulated.grow(binBounds[split - 1]);
+                accumulatedCount += binCount[split - 1];
+                if (accumulatedCount == 0 || rightCount[split] == 0)
+                    continue;
+                float cost = accumulated.area() * accumulatedCount + rightArea[split] * rightCount[split];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = split;
+                }
+            }
+        }
+
+        uint32_t middle;
+        float leafCost = bounds.area() * count;
+        if (bestAxis >= 0 && (bestCost < leafCost || count > MAX_LEAF_SIZE)) {
+            float scale = BIN_COUNT / extent[bestAxis];
+            float minimum = centroids.min[bestAxis];
+            middle = std::partition(objectIndices.begin() + begin, objectIndices.begin() + end, [&](uint32_t object) {
+                int bin = std::min(BIN_COUNT - 1, (int) ((objectBounds[object].center()[bestAxis] - minimum) * scale));
+                return bin < bestSplit;
+            }) - objectIndices.begin();
+        } else if (count <= MAX_LEAF_SIZE) {
+            makeLeaf(nodeIndex, begin, end);
+            return;
+        } else {
+            middle = begin + count / 2; // all centroids in one spot, split the list in half
+        }
+
+        uint32_t left = nodes.size();
+        nodes.push_back(Node());
+        nodes.push_back(Node());
+        nodes[left].parent = nodeIndex;
+        nodes[left + 1].parent = nodeIndex;
+        nodes[nodeIndex].first = left;
+        nodes[nodeIndex].count = 0;
+        subdivide(left, begin, middle, depth + 1);
+        subdivide(left + 1, middle, end, depth + 1);
+    }
+};
+#endif
@@ -109,7 +109,15 @@ public:
         if (Zoom < 1.0f)
             Zoom = 1.0f;
         if (Zoom > 45.0f)
-            Zoom = 45.0f; 
+            Zoom = 45.0f;
+    }
+
+    // sets the Euler angles directly, e.g. to follow a scripted path
+    void SetOrientation(float yaw, float pitch)
+    {
+        Yaw = yaw;
+        Pitch = glm::clamp(pitch, -89.0f, 89.0f);
+        updateCameraVectors();
     }
 
 private:
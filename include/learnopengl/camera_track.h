@@ -0,0 +1,169 @@
+#ifndef CAMERA_TRACK_H
+#define CAMERA_TRACK_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// the state of one frame that decides what gets drawn
+struct CameraTrackFrame {
+    glm::vec3 position = glm::vec3(0.0f);
+    float yaw = 0.0f;
+    float pitch = 0.0f;
+    float zoom = 45.0f;
+    bool blinn = false;
+    bool bloom = false;
+    bool hdr = false;
+    bool spectatorMode = false;
+    bool headlight = false;
+};
+
+// A recording of the camera and the render toggles at a fixed timestep, for runs that have to see exactly
+// the same frames: replaying a track plays one of its frames per rendered frame, however fast they come.
+//
+// Record() is fed the live state once per rendered frame and resamples it: a frame is appended for every tick
+// of the timestep passed since the previous call, repeating the state when the loop ran slower than the
+// track. The file is a header ("XWTR", version, timestep, frame count) and 25 bytes per frame: position, yaw,
+// pitch and zoom as floats and the toggles in a byte, all in the machine's byte order.
+class CameraTrack
+{
+public:
+    static const uint32_t VERSION = 1;
+
+    explicit CameraTrack(float timestep = 1.0f / 60.0f) : timestep(timestep)
+    {
+    }
+
+    // seconds between two frames
+    float Timestep() const
+    {
+        return timestep;
+    }
+
+    size_t FrameCount() const
+    {
+        return frames.size();
+    }
+
+    const CameraTrackFrame &Frame(size_t index) const
+    {
+        return frames[index];
+    }
+
+    // seconds is the time of the rendered frame, the first call starts the track
+    void Record(float seconds, const CameraTrackFrame &frame)
+    {
+        if (frames.empty())
+            start = seconds;
+        while (start + frames.size() * timestep <= seconds)
+            frames.push_back(frame);
+    }
+
+    bool Save(const std::string &path) const
+    {
+        std::ofstream out(path, std::ios::binary);
+        uint32_t version = VERSION, count = (uint32_t) frames.size();
+        out.write(MAGIC, 4);
+        write(out, version);
+        write(out, timestep);
+        write(out, count);
+        for (const CameraTrackFrame &frame : frames) {
+            write(out, frame.position.x);
+            write(out, frame.position.y);
+            write(out, frame.position.z);
+            write(out, frame.yaw);
+            write(out, frame.pitch);
+            write(out, frame.zoom);
+            uint8_t flags = (frame.blinn ? BLINN : 0) | (frame.bloom ? BLOOM : 0) | (frame.hdr ? HDR : 0) |
+                            (frame.spectatorMode ? SPECTATOR : 0) | (frame.headlight ? HEADLIGHT : 0);
+            write(out, flags);
+        }
+        if (!out) {
+            std::cout << "Failed to write camera track " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool Load(const std::string &path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        char magic[4] = {0};
+        uint32_t version = 0, count = 0;
+        in.read(magic, 4);
+        read(in, version);
+        read(in, timestep);
+        read(in, count);
+        if (!in || memcmp(magic, MAGIC, 4) != 0 || version != VERSION || !(timestep > 0.0f)) {
+            std::cout << "Failed to read camera track " << path << ": not a version " << VERSION << " track" << std::endl;
+            return false;
+        }
+        // the frame count has to match the file size, so a corrupt header can't ask for gigabytes of frames
+        std::streampos framesStart = in.tellg();
+        in.seekg(0, std::ios::end);
+        std::streamoff frameBytes = in.tellg() - framesStart;
+        in.seekg(framesStart);
+        if (!in || frameBytes != (std::streamoff) count * FRAME_BYTES) {
+            std::cout << "Failed to read camera track " << path << ": truncated or empty" << std::endl;
+            frames.clear();
+            return false;
+        }
+        frames.assign(count, CameraTrackFrame());
+        for (CameraTrackFrame &frame : frames) {
+            uint8_t flags = 0;
+            read(in, frame.position.x);
+            read(in, frame.position.y);
+            read(in, frame.position.z);
+            read(in, frame.yaw);
+            read(in, frame.pitch);
+            read(in, frame.zoom);
+            read(in, flags);
+            frame.blinn = flags & BLINN;
+            frame.bloom = flags & BLOOM;
+            frame.hdr = flags & HDR;
+            frame.spectatorMode = flags & SPECTATOR;
+            frame.headlight = flags & HEADLIGHT;
+        }
+        if (!in || frames.empty()) {
+            std::cout << "Failed to read camera track " << path << ": truncated or empty" << std::endl;
+            frames.clear();
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static constexpr const char *MAGIC = "XWTR";
+    // 6 floats and the flags byte
+    static const std::streamoff FRAME_BYTES = 25;
+    enum Flags : uint8_t {
+        BLINN = 1,
+        BLOOM = 2,
+        HDR = 4,
+        SPECTATOR = 8,
+        HEADLIGHT = 16
+    };
+
+    vector<CameraTrackFrame> frames;
+    float timestep;
+    float start = 0.0f;
+
+    template<typename T>
+    static void write(std::ofstream &out, const T &value)
+    {
+        out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    static void read(std::ifstream &in, T &value)
+    {
+        in.read(reinterpret_cast<char *>(&value), sizeof(T));
+    }
+};
+#endif
@@ -0,0 +1,350 @@
+#ifndef CLUSTERED_LIGHTS_H
+#define CLUSTERED_LIGHTS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/cpu_profiler.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define CLUSTERED_LIGHTS_SSE 1
+#endif
+
+// a point or spot light, uploaded as is: four RGBA32F texels in the light buffer (see newShader.fs)
+struct ClusteredLight {
+    glm::vec3 position;
+    float radius;      // the light is cut off (smoothly) at this distance
+    glm::vec3 direction;
+    float cutOff;      // cosines of the spot cone, a point light has a cone that includes everything
+    glm::vec3 diffuse;
+    float outerCutOff;
+    float linear;      // attenuation 1 / (1 + linear * d + quadratic * d^2)
+    float quadratic;
+    float specular;
+    float padding;
+
+    static ClusteredLight Point(const glm::vec3 &position, const glm::vec3 &color, float linear, float quadratic, float specular = 1.0f)
+    {
+        return Spot(position, glm::vec3(0.0f, 0.0f, -1.0f), color, -1.0f, -2.0f, linear, quadratic, specular);
+    }
+
+    static ClusteredLight Spot(const glm::vec3 &position, const glm::vec3 &direction, const glm::vec3 &color, float cutOff,
+                               float outerCutOff, float linear, float quadratic, float specular = 1.0f)
+    {
+        ClusteredLight light;
+        light.position = position;
+        light.direction = direction;
+        light.diffuse = color;
+        light.cutOff = cutOff;
+        light.outerCutOff = outerCutOff;
+        light.linear = linear;
+        light.quadratic = quadratic;
+        light.specular = specular;
+        light.padding = 0.0f;
+        light.radius = Range(std::max(std::max(color.x, color.y), std::max(color.z, specular)), linear, quadratic);
+        return light;
+    }
+
+    // distance where the attenuated brightness drops to 1/64 (invisible after tone mapping)
+    static float Range(float brightness, float linear, float quadratic)
+    {
+        float c = 1.0f - brightness * 64.0f;
+        if (c >= 0.0f)
+            return 0.0f;
+        if (quadratic <= 0.0f)
+            return linear > 0.0f ? -c / linear : 1e6f;
+        return (-linear + std::sqrt(linear * linear - 4.0f * quadratic * c)) / (2.0f * quadratic);
+    }
+};
+
+static_assert(sizeof(ClusteredLight) == 64, "ClusteredLight is uploaded as four vec4 texels");
+
+// contents of the ClusterData uniform block, has to match its std140 layout
+struct ClusterData {
+    glm::vec4 grid;  // number of clusters along x, y and z
+    glm::vec4 scale; // xy: clusters per pixel, zw: slice = log(view depth) * z + w
+};
+
+// Clustered forward lighting: the view frustum is divided into a grid of clusters (screen tiles times
+// exponentially spaced depth slices) and every cluster gets the list of lights whose sphere touches it.
+// A fragment then only loops over the lights of its own cluster, so the cost per pixel depends on how
+// many lights overlap there, not on how many there are.
+//
+// The grid is built on the CPU every frame: each light is tested only against the clusters under its screen
+// bounds, four clusters per SSE instruction, and the lists are put in one array with a counting sort. The
+// lights, the (first, count) range per cluster and the light indices are uploaded into buffer textures.
+class ClusteredLights
+{
+public:
+    static const unsigned int TILES_X = 16;
+    static const unsigned int TILES_Y = 9;
+    static const unsigned int SLICES = 24;
+    static const unsigned int CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+    static const unsigned int MAX_LIGHTS = 65535; // indices are 16 bit
+
+    // what the last Build did
+    struct Stats {
+        unsigned int lights = 0;
+        unsigned int visibleLights = 0;  // touching at least one cluster
+        unsigned int references = 0;     // entries in all the cluster lists
+        unsigned int maxPerCluster = 0;
+        float buildMilliseconds = 0.0f;
+    };
+
+    ClusteredLights()
+    {
+        glGenBuffers(3, buffers);
+        glGenTextures(3, textures);
+        const GLenum formats[3] = {GL_RGBA32F, GL_RG32UI, GL_R16UI};
+        for (int i = 0; i < 3; i++) {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+        }
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        clusterRanges.resize(CLUSTER_COUNT * 2);
+        clusterCounts.resize(CLUSTER_COUNT);
+    }
+
+    ~ClusteredLights()
+    {
+        glDeleteTextures(3, textures);
+        glDeleteBuffers(3, buffers);
+    }
+
+    ClusteredLights(const ClusteredLights &) = delete;
+    ClusteredLights &operator=(const ClusteredLights &) = delete;
+
+    // the lights are collected anew every frame: Clear, Add, Build
+    void Clear()
+    {
+        lights.clear();
+    }
+
+    void Add(const ClusteredLight &light)
+    {
+        if (lights.size() < MAX_LIGHTS)
+            lights.push_back(light);
+    }
+
+    size_t Size() const
+    {
+        return lights.size();
+    }
+
+    // bins the lights into the clusters of the camera and uploads everything. view is the camera's view
+    // matrix, the rest its perspective projection and the size of the framebuffer drawn to in pixels.
+    void Build(const glm::mat4 &view, float fovy, float aspect, float nearPlane, float farPlane, unsigned int width, unsigned int height)
+    {
+        PROFILE_SCOPE("Light clustering");
+        auto start = std::chrono::steady_clock::now();
+        if (fovy != gridFovy || aspect != gridAspect || nearPlane != gridNear || farPlane != gridFar)
+            buildClusterBounds(fovy, aspect, nearPlane, farPlane);
+        data.grid = glm::vec4(TILES_X, TILES_Y, SLICES, 0.0f);
+        float logRange = std::log(farPlane / nearPlane);
+        data.scale = glm::vec4((float) TILES_X / width, (float) TILES_Y / height, SLICES / logRange, -(float) SLICES * std::log(nearPlane) / logRange);
+
+        stats = Stats();
+        stats.lights = lights.size();
+        pairClusters.clear();
+        pairLights.clear();
+        for (uint32_t i = 0; i < lights.size(); i++) {
+            size_t before = pairClusters.size();
+            binLight(i, glm::vec3(view * glm::vec4(lights[i].position, 1.0f)), lights[i].radius);
+            if (pairClusters.size() > before)
+                stats.visibleLights++;
+        }
+
+        // counting sort of the (cluster, light) pairs by cluster
+        std::fill(clusterCounts.begin(), clusterCounts.end(), 0u);
+        for (uint32_t cluster : pairClusters)
+            clusterCounts[cluster]++;
+        uint32_t first = 0;
+        for (unsigned int c = 0; c < CLUSTER_COUNT; c++) {
+            clusterRanges[c * 2] = first;
+            clusterRanges[c * 2 + 1] = clusterCounts[c];
+            stats.maxPerCluster = std::max(stats.maxPerCluster, clusterCounts[c]);
+            clusterCounts[c] = first; // from here on the cursor of the cluster
+            first += clusterRanges[c * 2 + 1];
+        }
+        lightIndices.resize(pairClusters.size());
+        for (size_t i = 0; i < pairClusters.size(); i++)
+            lightIndices[clusterCounts[pairClusters[i]]++] = (uint16_t) pairLights[i];
+        stats.references = lightIndices.size();
+
+        upload(buffers[0], lights.data(), lights.size() * sizeof(ClusteredLight));
+        upload(buffers[1], clusterRanges.data(), clusterRanges.size() * sizeof(uint32_t));
+        upload(buffers[2], lightIndices.data(), lightIndices.size() * sizeof(uint16_t));
+        stats.buildMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    const ClusterData &Data() const
+    {
+        return data;
+    }
+
+    const Stats &GetStats() const
+    {
+        return stats;
+    }
+
+    // binds the lights, the cluster ranges and the light indices to firstUnit and the two units after it
+    void Bind(unsigned int firstUnit) const
+    {
+        for (unsigned int i = 0; i < 3; i++) {
+            glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+private:
+    vector<ClusteredLight> lights;
+    ClusterData data;
+    Stats stats;
+    unsigned int buffers[3];
+    unsigned int textures[3];
+    // view space bounds of every cluster (x and y as seen, z as the distance in front of the camera),
+    // structure of arrays so four neighbours along x load at once
+    vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+    float gridFovy = 0.0f, gridAspect = 0.0f, gridNear = 0.0f, gridFar = 0.0f;
+    float tanX = 1.0f, tanY = 1.0f;
+    // per frame scratch
+    vector<uint32_t> pairClusters, pairLights;
+    vector<uint32_t> clusterCounts;
+    vector<uint32_t> clusterRanges;
+    vector<uint16_t> lightIndices;
+
+    static unsigned int clusterIndex(unsigned int x, unsigned int y, unsigned int z)
+    {
+        return (z * TILES_Y + y) * TILES_X + x;
+    }
+
+    float sliceDepth(unsigned int slice) const
+    {
+        return gridNear * std::pow(gridFar / gridNear, (float) slice / SLICES);
+    }
+
+    // the slice that contains depth, clamped to the grid
+    unsigned int sliceOf(float depth) const
+    {
+        if (depth <= gridNear)
+            return 0;
+        int slice = (int) std::floor(std::log(depth / gridNear) / std::log(gridFar / gridNear) * SLICES);
+        return (unsigned int) std::min(std::max(slice, 0), (int) SLICES - 1);
+    }
+
+    static unsigned int tileOf(float ndc, unsigned int tiles)
+    {
+        int tile = (int) std::floor((ndc + 1.0f) * 0.5f * tiles);
+        return (unsigned int) std::min(std::max(tile, 0), (int) tiles - 1);
+    }
+
+    // only changes with the projection
+    void buildClusterBounds(float fovy, float aspect, float nearPlane, float farPlane)
+    {
+        gridFovy = fovy;
+        gridAspect = aspect;
+        gridNear = nearPlane;
+        gridFar = farPlane;
+        tanY = std::tan(fovy * 0.5f);
+        tanX = tanY * aspect;
+        for (vector<float> *bounds : {&minX, &minY, &minZ, &maxX, &maxY, &maxZ})
+            bounds->resize(CLUSTER_COUNT);
+        for (unsigned int z = 0; z < SLICES; z++) {
+            float zNear = sliceDepth(z), zFar = sliceDepth(z + 1);
+            for (unsigned int y = 0; y < TILES_Y; y++) {
+                float y0 = (-1.0f + 2.0f * y / TILES_Y) * tanY, y1 = (-1.0f + 2.0f * (y + 1) / TILES_Y) * tanY;
+                for (unsigned int x = 0; x < TILES_X; x++) {
+                    float x0 = (-1.0f + 2.0f * x / TILES_X) * tanX, x1 = (-1.0f + 2.0f * (x + 1) / TILES_X) * tanX;
+                    // the tile's sides are planes through the eye, so the extremes are at the near or far end
+                    unsigned int c = clusterIndex(x, y, z);
+                    minX[c] = std::min(x0 * zNear, x0 * zFar);
+                    maxX[c] = std::max(x1 * zNear, x1 * zFar);
+                    minY[c] = std::min(y0 * zNear, y0 * zFar);
+                    maxY[c] = std::max(y1 * zNear, y1 * zFar);
+                    minZ[c] = zNear;
+                    maxZ[c] = zFar;
+                }
+            }
+        }
+    }
+
+    // adds a pair for every cluster the light's sphere touches, center is in view space
+    void binLight(uint32_t light, const glm::vec3 &center, float radius)
+    {
+        float depth = -center.z;
+        if (radius <= 0.0f || depth + radius < gridNear || depth - radius > gridFar)
+            return;
+        float nearest = std::max(depth - radius, gridNear), farthest = std::min(depth + radius, gridFar);
+        unsigned int z0 = sliceOf(nearest), z1 = sliceOf(farthest);
+        // screen bounds of the sphere's box: x / depth is smallest or largest at one of the depth extremes
+        float left = std::min((center.x - radius) / nearest, (center.x - radius) / farthest) / tanX;
+        float right = std::max((center.x + radius) / nearest, (center.x + radius) / farthest) / tanX;
+        float bottom = std::min((center.y - radius) / nearest, (center.y - radius) / farthest) / tanY;
+        float top = std::max((center.y + radius) / nearest, (center.y + radius) / farthest) / tanY;
+        if (left > 1.0f || right < -1.0f || bottom > 1.0f || top < -1.0f)
+            return;
+        unsigned int x0 = tileOf(left, TILES_X), x1 = tileOf(right, TILES_X);
+        unsigned int y0 = tileOf(bottom, TILES_Y), y1 = tileOf(top, TILES_Y);
+
+        float radiusSquared = radius * radius;
+#ifdef CLUSTERED_LIGHTS_SSE
+        __m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(depth);
+        __m128 r2 = _mm_set1_ps(radiusSquared), zero = _mm_setzero_ps();
+#endif
+        for (unsigned int z = z0; z <= z1; z++) {
+            for (unsigned int y = y0; y <= y1; y++) {
+                unsigned int x = x0;
+#ifdef CLUSTERED_LIGHTS_SSE
+                // sphere against four boxes: squared distance from the center to the closest point of each
+                for (; x + 4 <= x1 + 1; x += 4) {
+                    unsigned int c = clusterIndex(x, y, z);
+                    __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minX[c]), cx), _mm_sub_ps(cx, _mm_loadu_ps(&maxX[c]))), zero);
+                    __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minY[c]), cy), _mm_sub_ps(cy, _mm_loadu_ps(&maxY[c]))), zero);
+                    __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minZ[c]), cz), _mm_sub_ps(cz, _mm_loadu_ps(&maxZ[c]))), zero);
+                    __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                    int mask = _mm_movemask_ps(_mm_cmple_ps(distance, r2));
+                    for (int lane = 0; lane < 4; lane++) {
+                        if (mask & (1 << lane)) {
+                            pairClusters.push_back(c + lane);
+                            pairLights.push_back(light);
+                        }
+                    }
+                }
+#endif
+                for (; x <= x1; x++) {
+                    unsigned int c = clusterIndex(x, y, z);
+                    float dx = std::max(std::max(minX[c] - center.x, center.x - maxX[c]), 0.0f);
+                    float dy = std::max(std::max(minY[c] - center.y, center.y - maxY[c]), 0.0f);
+                    float dz = std::max(std::max(minZ[c] - depth, depth - maxZ[c]), 0.0f);
+                    if (dx * dx + dy * dy + dz * dz <= radiusSquared) {
+                        pairClusters.push_back(c);
+                        pairLights.push_back(light);
+                    }
+                }
+            }
+        }
+    }
+
+    // orphans the buffer's storage and fills it, never empty so the texture stays valid
+    static void upload(unsigned int buffer, const void *contents, size_t size)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, std::max(size, (size_t) 16), nullptr, GL_STREAM_DRAW);
+        if (size > 0)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, size, contents);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+};
+#endif
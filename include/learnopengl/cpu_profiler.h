@@ -0,0 +1,175 @@
+#ifndef CPU_PROFILER_H
+#define CPU_PROFILER_H
+
+#include <iostream>
+#include <string>
+
+// PROFILE_SCOPE("name") times the rest of the enclosing block on the calling thread, PROFILE_THREAD_NAME names
+// the thread in the trace and PROFILE_WRITE_TRACE(path) writes what was recorded as Chrome trace_event JSON
+// (chrome://tracing, ui.perfetto.dev). All of it is compiled out unless PROFILING_ENABLED is defined, which
+// CMake does when configured with -DPROFILING=ON.
+#ifdef PROFILING_ENABLED
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Every thread records into a ring of its own, so recording takes no lock: the event is written and then
+// published by bumping the ring's atomic count. A ring is created, under a lock, the first time its thread
+// records; rings live as long as the program, their events can still be written out after the thread ended.
+// Only the newest RING_SIZE events of a thread are kept. Writing the trace while other threads record can
+// tear the events they are overwriting right then, the trace is best taken between frames or at exit.
+class CpuProfiler
+{
+public:
+    static const unsigned int RING_SIZE = 1 << 15; // events per thread, a power of two
+
+    // nanoseconds since the profiler started
+    static uint64_t Now()
+    {
+        return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - Get().start).count();
+    }
+
+    static void Record(const char *name, uint64_t begin, uint64_t end)
+    {
+        ThreadRing &ring = threadRing();
+        uint64_t index = ring.written.load(std::memory_order_relaxed);
+        Event &event = ring.events[index & (RING_SIZE - 1)];
+        event.name = name;
+        event.begin = begin;
+        event.end = end;
+        ring.written.store(index + 1, std::memory_order_release);
+    }
+
+    static void SetThreadName(const std::string &name)
+    {
+        ThreadRing &ring = threadRing();
+        std::lock_guard<std::mutex> lock(Get().mutex);
+        ring.name = name;
+    }
+
+    static bool WriteChromeTrace(const std::string &path)
+    {
+        CpuProfiler &profiler = Get();
+        std::ofstream out(path);
+        if (!out) {
+            std::cout << "Failed to write trace " << path << std::endl;
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(profiler.mutex);
+        size_t events = 0;
+        out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        bool first = true;
+        for (const std::unique_ptr<ThreadRing> &ring : profiler.rings) {
+            out << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << ring->id
+                << ", \"args\": {\"name\": \"" << escaped(ring->name.c_str()) << "\"}}";
+            first = false;
+            uint64_t written = ring->written.load(std::memory_order_acquire);
+            for (uint64_t i = written > RING_SIZE ? written - RING_SIZE : 0; i < written; i++) {
+                const Event &event = ring->events[i & (RING_SIZE - 1)];
+                char times[96];
+                // microseconds
+                snprintf(times, sizeof(times), "\"ts\": %.3f, \"dur\": %.3f", event.begin / 1000.0, (event.end - event.begin) / 1000.0);
+                out << ",\n{\"name\": \"" << escaped(event.name) << "\", \"ph\": \"X\", " << times << ", \"pid\": 1, \"tid\": " << ring->id << "}";
+                events++;
+            }
+        }
+        out << "\n]}\n";
+        std::cout << "Wrote " << events << " events of " << profiler.rings.size() << " threads to " << path << std::endl;
+        return true;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Event {
+        const char *name;
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    struct ThreadRing {
+        std::string name;
+        unsigned int id = 0;
+        std::atomic<uint64_t> written{0};
+        Event events[RING_SIZE];
+    };
+
+    Clock::time_point start = Clock::now();
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadRing>> rings;
+
+    static CpuProfiler &Get()
+    {
+        static CpuProfiler profiler;
+        return profiler;
+    }
+
+    static ThreadRing &threadRing()
+    {
+        thread_local ThreadRing *ring = nullptr;
+        if (!ring) {
+            CpuProfiler &profiler = Get();
+            std::lock_guard<std::mutex> lock(profiler.mutex);
+            profiler.rings.emplace_back(new ThreadRing());
+            ring = profiler.rings.back().get();
+            ring->id = (unsigned int) profiler.rings.size();
+            ring->name = "thread " + std::to_string(ring->id);
+        }
+        return *ring;
+    }
+
+    static std::string escaped(const char *text)
+    {
+        std::string result;
+        for (; *text; text++) {
+            if (*text == '"' || *text == '\\')
+                result += '\\';
+            if ((unsigned char) *text >= 0x20)
+                result += *text;
+        }
+        return result;
+    }
+};
+
+// records the time from its construction to the end of its scope
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char *name) : name(name), begin(CpuProfiler::Now())
+    {
+    }
+
+    ~ProfileScope()
+    {
+        CpuProfiler::Record(name, begin, CpuProfiler::Now());
+    }
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+    const char *name;
+    uint64_t begin;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+// name has to outlive the trace, a string literal
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_THREAD_NAME(name) CpuProfiler::SetThreadName(name)
+#define PROFILE_WRITE_TRACE(path) CpuProfiler::WriteChromeTrace(path)
+
+#else
+
+#define PROFILE_SCOPE(name) ((void) 0)
+#define PROFILE_THREAD_NAME(name) ((void) 0)
+#define PROFILE_WRITE_TRACE(path) (std::cout << "Built without PROFILING_ENABLED, no trace written to " << (path) << std::endl, false)
+
+#endif
+#endif
@@ -0,0 +1,159 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+
+// Picks the resolution scale of the scene from how long the GPU took for the last frames.
+//
+// Every frame is bracketed by two timestamp queries (timestamps rather than GL_TIME_ELAPSED, those can't
+// overlap other timer queries). Their results arrive a few frames later, the ring has QUERY_COUNT slots so
+// the CPU never waits for one. The GPU time is smoothed, and when it leaves the band between lowWater and
+// 100% of the budget the scale moves towards the one that would land in the middle of the band, assuming the
+// time is proportional to the pixel count (scale squared). Steps are limited and rounded to STEP, and after
+// a change the frames still in flight at the old scale are ignored and MIN_SAMPLES new ones are waited for,
+// so the scale doesn't oscillate.
+class DynamicResolution
+{
+public:
+    static const unsigned int QUERY_COUNT = 4;
+    static constexpr float STEP = 0.025f;
+    static const unsigned int MIN_SAMPLES = 8; // measurements at a scale before it is changed again
+
+    struct Settings {
+        bool enabled = true;
+        float targetMilliseconds = 16.0f; // the GPU budget of a frame
+        float lowWater = 0.75f;           // below this fraction of the budget the scale goes up again
+        float minScale = 0.5f;
+        float maxScale = 1.0f;
+        float maxStep = 0.1f;             // largest change of the scale at once
+    };
+
+    DynamicResolution()
+    {
+        for (Slot &slot : slots)
+            glGenQueries(2, slot.queries);
+    }
+
+    ~DynamicResolution()
+    {
+        for (Slot &slot : slots)
+            glDeleteQueries(2, slot.queries);
+    }
+
+    DynamicResolution(const DynamicResolution &) = delete;
+    DynamicResolution &operator=(const DynamicResolution &) = delete;
+
+    const Settings &GetSettings() const
+    {
+        return settings;
+    }
+
+    void SetSettings(const Settings &changed)
+    {
+        settings = changed;
+        float smallest = STEP;
+        settings.minScale = std::max(smallest, std::min(settings.minScale, 1.0f));
+        settings.maxScale = std::max(settings.minScale, std::min(settings.maxScale, 1.0f));
+        if (!settings.enabled)
+            scale = settings.maxScale;
+        scale = std::max(settings.minScale, std::min(scale, settings.maxScale));
+    }
+
+    // picks up finished measurements, adjusts the scale and starts measuring this frame
+    void BeginFrame()
+    {
+        collect();
+        Slot &slot = slots[next];
+        current = slot.pending ? nullptr : &slot; // all slots in flight: this frame goes unmeasured
+        if (current) {
+            glQueryCounter(current->queries[0], GL_TIMESTAMP);
+            current->scale = scale;
+        }
+    }
+
+    // after the last GL command of the frame
+    void EndFrame()
+    {
+        if (!current)
+            return;
+        glQueryCounter(current->queries[1], GL_TIMESTAMP);
+        current->pending = true;
+        current = nullptr;
+        next = (next + 1) % QUERY_COUNT;
+    }
+
+    // resolution scale of the scene for this frame, in each dimension
+    float Scale() const
+    {
+        return scale;
+    }
+
+    // GPU time of the newest measured frame, 0 until the first one arrived
+    float GpuMilliseconds() const
+    {
+        return lastMilliseconds;
+    }
+
+private:
+    struct Slot {
+        unsigned int queries[2] = {0, 0};
+        bool pending = false;
+        float scale = 1.0f; // the scale the frame was drawn with
+    };
+
+    Settings settings;
+    Slot slots[QUERY_COUNT];
+    Slot *current = nullptr;
+    unsigned int next = 0;
+    float scale = 1.0f;
+    float smoothedMilliseconds = 0.0f; // at the current scale
+    unsigned int samples = 0;
+    float lastMilliseconds = 0.0f;
+
+    // oldest first, the slots finish in the order they were issued
+    void collect()
+    {
+        for (unsigned int i = 0; i < QUERY_COUNT; i++) {
+            Slot &slot = slots[(next + i) % QUERY_COUNT];
+            if (!slot.pending)
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(slot.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                return;
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(slot.queries[0], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(slot.queries[1], GL_QUERY_RESULT, &end);
+            slot.pending = false;
+            lastMilliseconds = (end - begin) / 1000000.0f;
+            // frames drawn before the last change tell nothing about the current scale
+            if (slot.scale == scale)
+                update(lastMilliseconds);
+        }
+    }
+
+    void update(float milliseconds)
+    {
+        smoothedMilliseconds = samples == 0 ? milliseconds : smoothedMilliseconds * 0.8f + milliseconds * 0.2f;
+        samples++;
+        if (!settings.enabled || samples < MIN_SAMPLES)
+            return;
+        float budget = settings.targetMilliseconds;
+        if (smoothedMilliseconds <= budget && smoothedMilliseconds >= budget * settings.lowWater)
+            return;
+        float goal = budget * (1.0f + settings.lowWater) * 0.5f;
+        float wanted = scale * std::sqrt(goal / smoothedMilliseconds);
+        wanted = std::max(scale - settings.maxStep, std::min(wanted, scale + settings.maxStep));
+        wanted = std::round(wanted / STEP) * STEP;
+        wanted = std::max(settings.minScale, std::min(wanted, settings.maxScale));
+        if (wanted != scale) {
+            scale = wanted;
+            // the old average was measured at the other scale, start over with what the new one costs
+            samples = 0;
+        }
+    }
+};
+#endif
@@ -0,0 +1,166 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define FRUSTUM_SSE 1
+#endif
+
+// what the culling passes did this frame, reset by the caller once per frame
+struct CullingStats {
+    unsigned int meshesTested = 0;
+    unsigned int meshesDrawn = 0;
+    unsigned int instancesTested = 0;
+    unsigned int instancesDrawn = 0;
+    // inside the frustum but hidden behind earlier depth (HiZBuffer)
+    unsigned int meshesOccluded = 0;
+    unsigned int instancesOccluded = 0;
+
+    void reset()
+    {
+        *this = CullingStats();
+    }
+};
+
+// The six planes of a view frustum, extracted from a (projection * view [* model]) matrix.
+//
+// When the matrix includes a model matrix the planes are in that model's space, so local bounds can be
+// tested without transforming them. The planes are kept in structure-of-arrays form, padded to eight with
+// planes that accept everything, so the tests run on four planes per SSE instruction.
+// A default constructed Frustum accepts everything.
+class Frustum
+{
+public:
+    enum Result { OUTSIDE, INTERSECTS, INSIDE };
+
+    Frustum()
+    {
+        for (int i = 0; i < 8; i++)
+            setPlane(i, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    }
+
+    // Gribb/Hartmann: every plane is a sum or difference of the fourth row and one of the others
+    explicit Frustum(const glm::mat4 &m) : Frustum()
+    {
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+        setPlane(0, rows[3] + rows[0]); // left
+        setPlane(1, rows[3] - rows[0]); // right
+        setPlane(2, rows[3] + rows[1]); // bottom
+        setPlane(3, rows[3] - rows[1]); // top
+        setPlane(4, rows[3] + rows[2]); // near
+        setPlane(5, rows[3] - rows[2]); // far
+    }
+
+    bool SphereVisible(const glm::vec3 &center, float radius) const
+    {
+#ifdef FRUSTUM_SSE
+        __m128 x = _mm_set1_ps(center.x), y = _mm_set1_ps(center.y), z = _mm_set1_ps(center.z);
+        __m128 r = _mm_set1_ps(radius);
+        int outside = 0;
+        for (int i = 0; i < 8; i += 4) {
+            __m128 distance = planeDistance(i, x, y, z);
+            outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, r), _mm_setzero_ps()));
+        }
+        return outside == 0;
+#else
+        for (int i = 0; i < 6; i++)
+            if (planeX[i] * center.x + planeY[i] * center.y + planeZ[i] * center.z + planeW[i] + radius < 0.0f)
+                return false;
+        return true;
+#endif
+    }
+
+    // conservative: a box near a frustum corner can pass although it is outside
+    bool BoxVisible(const glm::vec3 &boxMin, const glm::vec3 &boxMax) const
+    {
+        glm::vec3 center = (boxMin + boxMax) * 0.5f;
+        glm::vec3 extent = (boxMax - boxMin) * 0.5f;
+#ifdef FRUSTUM_SSE
+        __m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+        __m128 ex = _mm_set1_ps(extent.x), ey = _mm_set1_ps(extent.y), ez = _mm_set1_ps(extent.z);
+        int outside = 0;
+        for (int i = 0; i < 8; i += 4) {
+            // distance of the center plus the box's projected radius onto the plane normal
+            __m128 distance = planeDistance(i, cx, cy, cz);
+            __m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(absX + i), ex), _mm_mul_ps(_mm_load_ps(absY + i), ey)),
+                                      _mm_mul_ps(_mm_load_ps(absZ + i), ez));
+            outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+        }
+        return outside == 0;
+#else
+        for (int i = 0; i < 6; i++) {
+            float distance = planeX[i] * center.x + planeY[i] * center.y + planeZ[i] * center.z + planeW[i];
+            float reach = absX[i] * extent.x + absY[i] * extent.y + absZ[i] * extent.z;
+            if (distance + reach < 0.0f)
+                return false;
+        }
+        return true;
+#endif
+    }
+
+    // like BoxVisible, but also tells whether the box is completely inside, so hierarchies can skip
+    // testing everything below it
+    Result ClassifyBox(const glm::vec3 &boxMin, const glm::vec3 &boxMax) const
+    {
+        glm::vec3 center = (boxMin + boxMax) * 0.5f;
+        glm::vec3 extent = (boxMax - boxMin) * 0.5f;
+#ifdef FRUSTUM_SSE
+        __m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+        __m128 ex = _mm_set1_ps(extent.x), ey = _mm_set1_ps(extent.y), ez = _mm_set1_ps(extent.z);
+        int outside = 0, crossing = 0;
+        for (int i = 0; i < 8; i += 4) {
+            __m128 distance = planeDistance(i, cx, cy, cz);
+            __m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(absX + i), ex), _mm_mul_ps(_mm_load_ps(absY + i), ey)),
+                                      _mm_mul_ps(_mm_load_ps(absZ + i), ez));
+            outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+            crossing |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(distance, reach), _mm_setzero_ps()));
+        }
+        return outside ? OUTSIDE : crossing ? INTERSECTS : INSIDE;
+#else
+        Result result = INSIDE;
+        for (int i = 0; i < 6; i++) {
+            float distance = planeX[i] * center.x + planeY[i] * center.y + planeZ[i] * center.z + planeW[i];
+            float reach = absX[i] * extent.x + absY[i] * extent.y + absZ[i] * extent.z;
+            if (distance + reach < 0.0f)
+                return OUTSIDE;
+            if (distance - reach < 0.0f)
+                result = INTERSECTS;
+        }
+        return result;
+#endif
+    }
+
+private:
+    alignas(16) float planeX[8], planeY[8], planeZ[8], planeW[8];
+    alignas(16) float absX[8], absY[8], absZ[8];
+
+    void setPlane(int i, glm::vec4 plane)
+    {
+        float length = std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+        if (length > 0.0f)
+            plane = plane * (1.0f / length);
+        planeX[i] = plane.x;
+        planeY[i] = plane.y;
+        planeZ[i] = plane.z;
+        planeW[i] = plane.w;
+        absX[i] = std::fabs(plane.x);
+        absY[i] = std::fabs(plane.y);
+        absZ[i] = std::fabs(plane.z);
+    }
+
+#ifdef FRUSTUM_SSE
+    __m128 planeDistance(int i, __m128 x, __m128 y, __m128 z) const
+    {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(planeX + i), x), _mm_mul_ps(_mm_load_ps(planeY + i), y)),
+                          _mm_add_ps(_mm_mul_ps(_mm_load_ps(planeZ + i), z), _mm_load_ps(planeW + i)));
+    }
+#endif
+};
+#endif
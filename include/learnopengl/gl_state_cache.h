@@ -0,0 +1,97 @@
+#ifndef GL_STATE_CACHE_H
+#define GL_STATE_CACHE_H
+
+#include <glad/glad.h>
+
+// Remembers the program, vertex array and texture bindings it has set and skips calls that would set the
+// same thing again. It only knows about calls made through it: Invalidate() before using it after any
+// other code touched these bindings (RenderQueue::Submit does).
+class GLStateCache
+{
+public:
+    static const unsigned int TEXTURE_UNITS = 16;
+
+    // GL calls made and skipped, reset by the caller once per frame
+    struct Stats {
+        unsigned int programChanges = 0;
+        unsigned int vertexArrayChanges = 0;
+        unsigned int textureChanges = 0;
+        unsigned int redundantSkipped = 0;
+        unsigned int drawCalls = 0;
+
+        void reset()
+        {
+            *this = Stats();
+        }
+    };
+
+    Stats stats;
+
+    GLStateCache()
+    {
+        Invalidate();
+    }
+
+    // forget everything, the next call of each kind goes to GL
+    void Invalidate()
+    {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (unsigned int i = 0; i < TEXTURE_UNITS; i++)
+            textures[i] = UNKNOWN;
+    }
+
+    void UseProgram(unsigned int id)
+    {
+        if (program == id) {
+            stats.redundantSkipped++;
+            return;
+        }
+        glUseProgram(id);
+        program = id;
+        stats.programChanges++;
+    }
+
+    void BindVertexArray(unsigned int id)
+    {
+        if (vertexArray == id) {
+            stats.redundantSkipped++;
+            return;
+        }
+        glBindVertexArray(id);
+        vertexArray = id;
+        stats.vertexArrayChanges++;
+    }
+
+    // 2D textures only, which is all meshes use
+    void BindTexture(unsigned int unit, unsigned int id)
+    {
+        if (unit < TEXTURE_UNITS && textures[unit] == id) {
+            stats.redundantSkipped++;
+            return;
+        }
+        if (activeUnit != unit) {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            activeUnit = unit;
+        }
+        glBindTexture(GL_TEXTURE_2D, id);
+        if (unit < TEXTURE_UNITS)
+            textures[unit] = id;
+        stats.textureChanges++;
+    }
+
+    unsigned int Program() const
+    {
+        return program;
+    }
+
+private:
+    static const unsigned int UNKNOWN = ~0u;
+
+    unsigned int program;
+    unsigned int vertexArray;
+    unsigned int activeUnit;
+    unsigned int textures[TEXTURE_UNITS];
+};
+#endif
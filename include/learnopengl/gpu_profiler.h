@@ -0,0 +1,204 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <glad/glad.h>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// GPU time per pass of the frame, from GL_TIME_ELAPSED queries.
+//
+// The passes are bracketed with Begin(name) and End() between BeginFrame() and EndFrame(). Time elapsed
+// queries can't nest, so scopes are flat: Begin() ends a scope that is still open. Every frame has its own
+// set of queries in a ring of FRAME_LATENCY frames; when a frame's set comes around again its results are
+// read if the GPU is done with them, and dropped otherwise, so the profiler never makes the CPU wait.
+//
+// The results are kept per scope name (a track): the newest time and a smoothed one for display, and the
+// last HISTORY frames of samples for the chart and for WriteCsv().
+class GpuProfiler
+{
+public:
+    static const unsigned int FRAME_LATENCY = 4;
+    static const unsigned int MAX_SCOPES = 32; // per frame, later ones aren't measured
+    static const unsigned int HISTORY = 240;   // frames
+
+    struct Track {
+        std::string name;
+        float milliseconds = 0.0f; // newest measurement, 0 if the scope didn't run that frame
+        float average = 0.0f;      // smoothed over the last frames
+    };
+
+    GpuProfiler()
+    {
+        for (FrameQueries &slot : slots)
+            glGenQueries(MAX_SCOPES, slot.queries);
+    }
+
+    ~GpuProfiler()
+    {
+        for (FrameQueries &slot : slots)
+            glDeleteQueries(MAX_SCOPES, slot.queries);
+    }
+
+    GpuProfiler(const GpuProfiler &) = delete;
+    GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+    // picks up the results of the frame FRAME_LATENCY frames ago
+    void BeginFrame()
+    {
+        FrameQueries &slot = slots[frame % FRAME_LATENCY];
+        if (slot.count > 0)
+            collect(slot);
+        slot.count = 0;
+        slot.frame = frame;
+        current = &slot;
+    }
+
+    // name has to stay valid until the frame's results are read, a string literal
+    void Begin(const char *name)
+    {
+        if (open)
+            End();
+        if (!current || current->count == MAX_SCOPES)
+            return;
+        current->names[current->count] = name;
+        glBeginQuery(GL_TIME_ELAPSED, current->queries[current->count]);
+        open = true;
+    }
+
+    void End()
+    {
+        if (!open)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        current->count++;
+        open = false;
+    }
+
+    void EndFrame()
+    {
+        End();
+        current = nullptr;
+        frame++;
+    }
+
+    // in the order the scopes first ran
+    const vector<Track> &Tracks() const
+    {
+        return tracks;
+    }
+
+    // the sum of the scopes of the last HISTORY frames, oldest first from HistoryOffset() on, for ImGui::PlotLines
+    const float *TotalHistory() const
+    {
+        return totals;
+    }
+
+    unsigned int HistoryOffset() const
+    {
+        return (unsigned int) (records.size() < HISTORY ? 0 : collected % HISTORY);
+    }
+
+    // frames whose results weren't ready when their queries were needed again
+    unsigned int DroppedFrames() const
+    {
+        return dropped;
+    }
+
+    // the kept frames as frame,scope,milliseconds rows
+    bool WriteCsv(const std::string &path) const
+    {
+        std::ofstream out(path);
+        if (!out) {
+            std::cout << "Failed to write GPU profile " << path << std::endl;
+            return false;
+        }
+        out << "frame,scope,milliseconds\n";
+        size_t first = records.size() < HISTORY ? 0 : collected % HISTORY;
+        for (size_t i = 0; i < records.size(); i++) {
+            const FrameRecord &record = records[(first + i) % records.size()];
+            for (const Sample &sample : record.samples)
+                out << record.frame << ',' << tracks[sample.track].name << ',' << sample.milliseconds << '\n';
+        }
+        return true;
+    }
+
+private:
+    struct FrameQueries {
+        unsigned int queries[MAX_SCOPES];
+        const char *names[MAX_SCOPES];
+        unsigned int count = 0;
+        unsigned long long frame = 0;
+    };
+
+    struct Sample {
+        unsigned int track;
+        float milliseconds;
+    };
+
+    struct FrameRecord {
+        unsigned long long frame = 0;
+        vector<Sample> samples;
+    };
+
+    FrameQueries slots[FRAME_LATENCY];
+    FrameQueries *current = nullptr;
+    bool open = false;
+    unsigned long long frame = 0;
+    vector<Track> tracks;
+    vector<FrameRecord> records; // ring of HISTORY once full
+    float totals[HISTORY] = {0.0f};
+    unsigned long long collected = 0;
+    unsigned int dropped = 0;
+
+    void collect(FrameQueries &slot)
+    {
+        // the last query finishes last
+        GLint available = 0;
+        glGetQueryObjectiv(slot.queries[slot.count - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            dropped++;
+            return;
+        }
+        FrameRecord record;
+        record.frame = slot.frame;
+        float total = 0.0f;
+        for (Track &track : tracks)
+            track.milliseconds = 0.0f;
+        for (unsigned int i = 0; i < slot.count; i++) {
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(slot.queries[i], GL_QUERY_RESULT, &nanoseconds);
+            Sample sample;
+            sample.track = trackIndex(slot.names[i]);
+            sample.milliseconds = nanoseconds / 1000000.0f;
+            // a name used twice in a frame adds up
+            tracks[sample.track].milliseconds += sample.milliseconds;
+            total += sample.milliseconds;
+            record.samples.push_back(sample);
+        }
+        for (Track &track : tracks)
+            track.average = track.average == 0.0f ? track.milliseconds : track.average * 0.95f + track.milliseconds * 0.05f;
+
+        totals[collected % HISTORY] = total;
+        if (records.size() < HISTORY)
+            records.push_back(record);
+        else
+            records[collected % HISTORY] = record;
+        collected++;
+    }
+
+    unsigned int trackIndex(const char *name)
+    {
+        for (unsigned int i = 0; i < tracks.size(); i++)
+            if (tracks[i].name == name)
+                return i;
+        Track track;
+        track.name = name;
+        tracks.push_back(track);
+        return (unsigned int) tracks.size() - 1;
+    }
+};
+#endif
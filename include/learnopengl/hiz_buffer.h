@@ -0,0 +1,383 @@
+#ifndef HIZ_BUFFER_H
+#define HIZ_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/cpu_profiler.h>
+#include <learnopengl/shader.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+// Hierarchical Z buffer for occlusion culling against the previous frames' depth.
+//
+// Build() reduces the scene's depth texture into a mip pyramid where every texel holds the farthest depth
+// below it, then reads a coarse level back through a pixel buffer. The readback is picked up a frame or two
+// later, when its fence has signaled, so the CPU never waits on the GPU; the rest of the pyramid is finished
+// on the CPU. A box is occluded when its nearest depth is behind the farthest depth of the few texels its
+// screen rectangle covers, both seen with the camera of the frame the depth came from.
+//
+// Objects that only became visible since then pop in a frame late, which is the price for not stalling.
+class HiZBuffer
+{
+public:
+    // tests bounds in one model space, like a Frustum built from (projection * view * model).
+    // a default constructed Test (or one made before any depth arrived) accepts everything.
+    class Test
+    {
+    public:
+        Test() = default;
+
+        bool BoxVisible(const glm::vec3 &boxMin, const glm::vec3 &boxMax) const
+        {
+            return !hiZ || hiZ->boxVisible(matrix, boxMin, boxMax);
+        }
+
+        bool SphereVisible(const glm::vec3 &center, float radius) const
+        {
+            return !hiZ || hiZ->boxVisible(matrix, center - glm::vec3(radius), center + glm::vec3(radius));
+        }
+
+    private:
+        friend class HiZBuffer;
+        const HiZBuffer *hiZ = nullptr;
+        glm::mat4 matrix;
+    };
+
+    unsigned int ID;         // the GPU pyramid, R32F, level 0 is half the depth buffer's size
+    unsigned int levelCount;
+    unsigned int DebugTexture; // one level drawn by DrawDebug
+
+    // width and height of the depth buffer
+    HiZBuffer(unsigned int width, unsigned int height)
+    {
+        glGenFramebuffers(1, &FBO);
+        glGenFramebuffers(1, &debugFBO);
+        glGenVertexArrays(1, &emptyVAO);
+        create(width, height);
+    }
+
+    ~HiZBuffer()
+    {
+        destroy();
+        glDeleteFramebuffers(1, &FBO);
+        glDeleteFramebuffers(1, &debugFBO);
+        glDeleteVertexArrays(1, &emptyVAO);
+    }
+
+    HiZBuffer(const HiZBuffer &) = delete;
+    HiZBuffer &operator=(const HiZBuffer &) = delete;
+
+    // follows a new size of the depth buffer, nothing happens if it is the same. the depth on the CPU is
+    // kept, it remembers the size it was built with.
+    void Resize(unsigned int width, unsigned int height)
+    {
+        if (glm::ivec2(width, height) == depthSize)
+            return;
+        destroy();
+        create(width, height);
+    }
+
+    // builds the pyramid from depthTexture (rendered with viewProjection) and starts its readback. only the
+    // bottom left corner of the Resize() size is read, depthTexture can be larger.
+    // downsampleShader is fullScreen.vs + hiZDownsample.fs. Leaves framebuffer 0 bound.
+    void Build(Shader &downsampleShader, unsigned int depthTexture, const glm::mat4 &viewProjection)
+    {
+        PROFILE_SCOPE("Hi-Z build");
+        collectReadbacks();
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+        glDisable(GL_DEPTH_TEST);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glBindVertexArray(emptyVAO);
+        downsampleShader.use();
+        downsampleShader.setInt("source", 0);
+        glActiveTexture(GL_TEXTURE0);
+        for (unsigned int level = 0; level < levelCount; level++) {
+            glm::ivec2 size = gpuLevelSize(baseSize.x, baseSize.y, level);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ID, level);
+            glViewport(0, 0, size.x, size.y);
+            if (level == 0) {
+                downsampleShader.setIVec2("sourceSize", depthSize);
+                glBindTexture(GL_TEXTURE_2D, depthTexture);
+            } else {
+                downsampleShader.setIVec2("sourceSize", gpuLevelSize(baseSize.x, baseSize.y, level - 1));
+                // only the level being read is visible to the sampler, so there is no feedback loop
+                glBindTexture(GL_TEXTURE_2D, ID);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+            }
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        glBindTexture(GL_TEXTURE_2D, ID);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        startReadback(viewProjection);
+
+        glBindVertexArray(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        if (depthTest)
+            glEnable(GL_DEPTH_TEST);
+    }
+
+    // occlusion test for bounds in the space of model, against the newest depth that reached the CPU
+    Test MakeTest(const glm::mat4 &model = glm::mat4(1.0f)) const
+    {
+        Test test;
+        if (cpuLevels.empty())
+            return test;
+        test.hiZ = this;
+        test.matrix = cpuViewProjection * model;
+        return test;
+    }
+
+    // forgets the depth on the CPU, e.g. when culling was switched off for a while and it is stale
+    void Invalidate()
+    {
+        cpuLevels.clear();
+    }
+
+    // draws one level of the GPU pyramid into DebugTexture, for the debug UI.
+    // debugShader is fullScreen.vs + hiZDebug.fs, near and far are the projection's planes.
+    void DrawDebug(Shader &debugShader, unsigned int level, float near, float far)
+    {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+        glDisable(GL_DEPTH_TEST);
+        glBindFramebuffer(GL_FRAMEBUFFER, debugFBO);
+        glViewport(0, 0, baseSize.x, baseSize.y);
+        debugShader.use();
+        debugShader.setInt("hiZ", 0);
+        debugShader.setInt("level", std::min(level, levelCount - 1));
+        debugShader.setFloat("nearPlane", near);
+        debugShader.setFloat("farPlane", far);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, ID);
+        glBindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        if (depthTest)
+            glEnable(GL_DEPTH_TEST);
+    }
+
+    glm::ivec2 DebugSize() const
+    {
+        return baseSize;
+    }
+
+private:
+    // the largest level read back, the CPU builds the coarser ones
+    static const int MAX_READBACK_WIDTH = 256;
+
+    struct Readback {
+        unsigned int PBO = 0;
+        GLsync fence = 0;
+        glm::mat4 viewProjection;
+    };
+
+    unsigned int FBO, debugFBO, emptyVAO;
+    unsigned int readbackLevel = 0;
+    glm::ivec2 depthSize, baseSize, readbackSize;
+    Readback readbacks[2];
+    unsigned int nextReadback = 0;
+
+    // CPU pyramid, level 0 is the GPU's readbackLevel. the depth buffer size and readback level it was
+    // built with are kept, a Resize doesn't change how its texels map to the screen.
+    vector<vector<float>> cpuLevels;
+    vector<glm::ivec2> cpuSizes;
+    glm::mat4 cpuViewProjection;
+    glm::ivec2 cpuDepthSize;
+    unsigned int cpuReadbackLevel = 0;
+
+    void create(unsigned int width, unsigned int height)
+    {
+        depthSize = glm::ivec2(width, height);
+        readbackLevel = 0;
+        unsigned int levelWidth = std::max(1u, width / 2), levelHeight = std::max(1u, height / 2);
+        levelCount = 1;
+        while (levelWidth >> levelCount > 0 || levelHeight >> levelCount > 0)
+            levelCount++;
+
+        glGenTextures(1, &ID);
+        glBindTexture(GL_TEXTURE_2D, ID);
+        for (unsigned int level = 0; level < levelCount; level++) {
+            glm::ivec2 size = gpuLevelSize(levelWidth, levelHeight, level);
+            glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, size.x, size.y, 0, GL_RED, GL_FLOAT, NULL);
+        }
+        while (readbackLevel + 1 < levelCount && gpuLevelSize(levelWidth, levelHeight, readbackLevel).x > MAX_READBACK_WIDTH)
+            readbackLevel++;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+        baseSize = glm::ivec2(levelWidth, levelHeight);
+        readbackSize = gpuLevelSize(levelWidth, levelHeight, readbackLevel);
+
+        for (Readback &readback : readbacks) {
+            glGenBuffers(1, &readback.PBO);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.PBO);
+            glBufferData(GL_PIXEL_PACK_BUFFER, readbackSize.x * readbackSize.y * sizeof(float), NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        // debug view of one level, linear depth as gray
+        glGenTextures(1, &DebugTexture);
+        glBindTexture(GL_TEXTURE_2D, DebugTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, baseSize.x, baseSize.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, debugFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, DebugTexture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "HiZ debug framebuffer not complete!" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // everything create() made. readbacks still in flight are dropped.
+    void destroy()
+    {
+        for (Readback &readback : readbacks) {
+            if (readback.fence)
+                glDeleteSync(readback.fence);
+            readback.fence = 0;
+            glDeleteBuffers(1, &readback.PBO);
+        }
+        glDeleteTextures(1, &ID);
+        glDeleteTextures(1, &DebugTexture);
+    }
+
+    static glm::ivec2 gpuLevelSize(int width, int height, unsigned int level)
+    {
+        return glm::ivec2(std::max(1, width >> level), std::max(1, height >> level));
+    }
+
+    void startReadback(const glm::mat4 &viewProjection)
+    {
+        Readback &readback = readbacks[nextReadback];
+        if (readback.fence)
+            return; // both buffers still in flight, skip a frame rather than wait
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ID, readbackLevel);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.PBO);
+        glReadPixels(0, 0, readbackSize.x, readbackSize.y, GL_RED, GL_FLOAT, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        readback.viewProjection = viewProjection;
+        nextReadback = (nextReadback + 1) % 2;
+    }
+
+    // takes the newest finished readback, oldest first so a newer one always wins
+    void collectReadbacks()
+    {
+        for (unsigned int i = 0; i < 2; i++) {
+            Readback &readback = readbacks[(nextReadback + i) % 2];
+            if (!readback.fence)
+                continue;
+            GLenum status = glClientWaitSync(readback.fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                continue;
+            glDeleteSync(readback.fence);
+            readback.fence = 0;
+
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.PBO);
+            size_t bytes = readbackSize.x * readbackSize.y * sizeof(float);
+            void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+            if (data) {
+                buildCpuLevels((const float *) data);
+                cpuViewProjection = readback.viewProjection;
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+    }
+
+    // same reduction as hiZDownsample.fs: odd sizes fold their last row/column into the last texel
+    void buildCpuLevels(const float *data)
+    {
+        cpuDepthSize = depthSize;
+        cpuReadbackLevel = readbackLevel;
+        cpuSizes.assign(1, readbackSize);
+        cpuLevels.resize(1);
+        cpuLevels[0].assign(data, data + readbackSize.x * readbackSize.y);
+        while (cpuSizes.back().x > 1 || cpuSizes.back().y > 1) {
+            glm::ivec2 source = cpuSizes.back();
+            glm::ivec2 size(std::max(1, source.x / 2), std::max(1, source.y / 2));
+            vector<float> level(size.x * size.y, 0.0f);
+            const vector<float> &previous = cpuLevels.back();
+            for (int y = 0; y < source.y; y++) {
+                int targetY = std::min(y / 2, size.y - 1);
+                for (int x = 0; x < source.x; x++) {
+                    float &target = level[targetY * size.x + std::min(x / 2, size.x - 1)];
+                    target = std::max(target, previous[y * source.x + x]);
+                }
+            }
+            cpuLevels.push_back(level);
+            cpuSizes.push_back(size);
+        }
+    }
+
+    bool boxVisible(const glm::mat4 &matrix, const glm::vec3 &boxMin, const glm::vec3 &boxMax) const
+    {
+        // the eight corners are the projected center plus or minus the projected half axes
+        glm::vec3 extent = (boxMax - boxMin) * 0.5f;
+        glm::vec4 center = matrix * glm::vec4((boxMin + boxMax) * 0.5f, 1.0f);
+        glm::vec4 axes[3] = {matrix[0] * extent.x, matrix[1] * extent.y, matrix[2] * extent.z};
+        glm::vec3 ndcMin(FLT_MAX), ndcMax(-FLT_MAX);
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec4 clip = center;
+            for (int axis = 0; axis < 3; axis++)
+                clip = corner & (1 << axis) ? clip + axes[axis] : clip - axes[axis];
+            if (clip.w <= 1e-5f)
+                return true; // reaches behind the camera, can't be occluded
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            ndcMin = glm::min(ndcMin, ndc);
+            ndcMax = glm::max(ndcMax, ndc);
+        }
+        if (ndcMax.x < -1.0f || ndcMin.x > 1.0f || ndcMax.y < -1.0f || ndcMin.y > 1.0f)
+            return true; // off the old screen, no depth to compare with
+
+        // the rectangle in depth buffer pixels. every reduction halves with the odd remainder folded into the
+        // last row/column, so a texel of CPU level l covers the pixels >> (cpuReadbackLevel + 1 + l), and the
+        // last texel of a row or column also those beyond. scaling NDC by the level's size instead drifts
+        // away from that as soon as a size was odd.
+        glm::vec2 pixels = glm::vec2(cpuDepthSize);
+        glm::vec2 low = (glm::clamp(glm::vec2(ndcMin), glm::vec2(-1.0f), glm::vec2(1.0f)) * 0.5f + 0.5f) * pixels;
+        glm::vec2 high = (glm::clamp(glm::vec2(ndcMax), glm::vec2(-1.0f), glm::vec2(1.0f)) * 0.5f + 0.5f) * pixels;
+
+        // the level where the rectangle spans at most two texels each way
+        int readbackShift = (int) cpuReadbackLevel + 1;
+        float span = std::max(high.x - low.x, high.y - low.y) / (float) (1 << readbackShift);
+        int level = span > 1.0f ? (int) std::ceil(std::log2(span)) : 0;
+        level = std::min(level, (int) cpuLevels.size() - 1);
+
+        const vector<float> &depth = cpuLevels[level];
+        glm::ivec2 levelSize = cpuSizes[level];
+        int shift = readbackShift + level;
+        int x0 = std::min((int) low.x >> shift, levelSize.x - 1), x1 = std::min((int) high.x >> shift, levelSize.x - 1);
+        int y0 = std::min((int) low.y >> shift, levelSize.y - 1), y1 = std::min((int) high.y >> shift, levelSize.y - 1);
+        float farthest = 0.0f;
+        for (int y = y0; y <= y1; y++)
+            for (int x = x0; x <= x1; x++)
+                farthest = std::max(farthest, depth[y * levelSize.x + x]);
+        float nearest = ndcMin.z * 0.5f + 0.5f;
+        return nearest <= farthest;
+    }
+};
+#endif
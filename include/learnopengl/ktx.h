@@ -0,0 +1,161 @@
+#ifndef KTX_H
+#define KTX_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/ktx_format.h>
+#include <learnopengl/mapped_file.h>
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Loads textures baked by bake_assets (<image>.ktx next to the original image).
+// The container is mapped and every mip level goes straight from the mapping to glCompressedTexImage2D,
+// there is nothing to decode and no mipmaps to generate.
+class Ktx
+{
+public:
+    static string PathFor(const string &imagePath)
+    {
+        return imagePath + ".ktx";
+    }
+
+    // true if a baked version of the image exists that isn't older than the image itself
+    static bool HasFreshBake(const string &imagePath)
+    {
+        struct stat baked, source;
+        if (stat(PathFor(imagePath).c_str(), &baked) != 0)
+            return false;
+        if (stat(imagePath.c_str(), &source) != 0)
+            return true; // only the baked version was shipped
+        return baked.st_mtime >= source.st_mtime;
+    }
+
+    // S3TC is an extension, so the driver might not have it (RGTC is core)
+    static bool IsFormatSupported(uint32_t internalFormat)
+    {
+        if (internalFormat == KTX_FORMAT_BC5)
+            return true;
+        static int s3tc = -1;
+        if (s3tc < 0) {
+            s3tc = 0;
+            GLint extensionCount = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+            for (GLint i = 0; i < extensionCount; i++) {
+                const char *name = (const char *) glGetStringi(GL_EXTENSIONS, i);
+                if (name && strcmp(name, "GL_EXT_texture_compression_s3tc") == 0)
+                    s3tc = 1;
+            }
+        }
+        return s3tc == 1;
+    }
+
+    // creates a 2D texture from a baked image, returns 0 if the file can't be used (the caller falls back to the source image)
+    static unsigned int Load2D(const string &ktxPath, bool clampAlpha, size_t &bytes)
+    {
+        MappedFile file;
+        const KtxHeader *header = openBaked(ktxPath, file);
+        if (!header)
+            return 0;
+
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        bytes = upload(header, file, GL_TEXTURE_2D);
+        if (bytes == 0) {
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glDeleteTextures(1, &textureID);
+            return 0;
+        }
+        GLenum wrap = clampAlpha && header->glBaseInternalFormat == KTX_BASE_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header->numberOfMipmapLevels - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return textureID;
+    }
+
+    // creates a cubemap from six baked faces (+X, -X, +Y, -Y, +Z, -Z), returns 0 if any of them can't be used
+    static unsigned int LoadCubemap(const vector<string> &ktxPaths, size_t &bytes)
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+        bytes = 0;
+        GLint levels = 1000;
+        for (unsigned int i = 0; i < ktxPaths.size(); i++) {
+            MappedFile file;
+            const KtxHeader *header = openBaked(ktxPaths[i], file);
+            size_t faceBytes = header ? upload(header, file, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i) : 0;
+            if (faceBytes == 0) {
+                glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+                glDeleteTextures(1, &textureID);
+                return 0;
+            }
+            bytes += faceBytes;
+            levels = std::min(levels, (GLint) header->numberOfMipmapLevels);
+        }
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        return textureID;
+    }
+
+private:
+    // maps the file and checks that it is something we can upload
+    static const KtxHeader *openBaked(const string &ktxPath, MappedFile &file)
+    {
+        if (!file.map(ktxPath) || file.size < sizeof(KtxHeader))
+            return nullptr;
+        const KtxHeader *header = (const KtxHeader *) file.data;
+        if (memcmp(header->identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0
+            || header->endianness != KTX_ENDIANNESS
+            || header->glType != 0 // compressed
+            || header->numberOfFaces != 1
+            || header->numberOfMipmapLevels == 0
+            || header->pixelWidth == 0 || header->pixelHeight == 0) {
+            std::cout << "WARNING::KTX:: unsupported or corrupt file " << ktxPath << std::endl;
+            return nullptr;
+        }
+        if (!IsFormatSupported(header->glInternalFormat))
+            return nullptr;
+        return header;
+    }
+
+    // uploads every mip level into the given target of the bound texture, returns the bytes uploaded (0 on error)
+    static size_t upload(const KtxHeader *header, const MappedFile &file, GLenum target)
+    {
+        size_t offset = sizeof(KtxHeader) + header->bytesOfKeyValueData;
+        size_t total = 0;
+        GLsizei width = header->pixelWidth;
+        GLsizei height = header->pixelHeight;
+        for (uint32_t level = 0; level < header->numberOfMipmapLevels; level++) {
+            if (offset + 4 > file.size)
+                return 0;
+            uint32_t imageSize;
+            memcpy(&imageSize, file.data + offset, 4);
+            offset += 4;
+            if (imageSize != KtxLevelBytes(header->glInternalFormat, width, height) || offset + imageSize > file.size)
+                return 0;
+            glCompressedTexImage2D(target, level, header->glInternalFormat, width, height, 0, imageSize, file.data + offset);
+            offset += (imageSize + 3) & ~3u;
+            total += imageSize;
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+        return total;
+    }
+};
+#endif
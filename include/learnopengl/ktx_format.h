@@ -0,0 +1,49 @@
+#ifndef KTX_FORMAT_H
+#define KTX_FORMAT_H
+
+#include <cstdint>
+
+// KTX 1.1 container as written by bake_assets and read by the engine (see ktx.h).
+// Only compressed 2D images are used: one face, no array elements, no key/value data, and a full mip chain.
+// Every mip level is stored as [uint32 imageSize][imageSize bytes of blocks].
+static const unsigned char KTX_IDENTIFIER[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+const uint32_t KTX_ENDIANNESS = 0x04030201;
+
+struct KtxHeader {
+    unsigned char identifier[12];
+    uint32_t endianness;
+    uint32_t glType;
+    uint32_t glTypeSize;
+    uint32_t glFormat;
+    uint32_t glInternalFormat;
+    uint32_t glBaseInternalFormat;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t numberOfArrayElements;
+    uint32_t numberOfFaces;
+    uint32_t numberOfMipmapLevels;
+    uint32_t bytesOfKeyValueData;
+};
+
+// block compressed formats produced by the baker. S3TC (BC1/BC3) comes from EXT_texture_compression_s3tc,
+// RGTC (BC5) is core since OpenGL 3.0. Spelled out here so the baker doesn't need GL headers.
+const uint32_t KTX_FORMAT_BC1 = 0x83F0; // GL_COMPRESSED_RGB_S3TC_DXT1_EXT, opaque color
+const uint32_t KTX_FORMAT_BC3 = 0x83F3; // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, color with alpha
+const uint32_t KTX_FORMAT_BC5 = 0x8DBD; // GL_COMPRESSED_RG_RGTC2, normal maps (x and y)
+
+const uint32_t KTX_BASE_RGB = 0x1907;  // GL_RGB
+const uint32_t KTX_BASE_RGBA = 0x1908; // GL_RGBA
+const uint32_t KTX_BASE_RG = 0x8227;   // GL_RG
+
+// bytes per 4x4 block
+inline uint32_t KtxBlockBytes(uint32_t internalFormat)
+{
+    return internalFormat == KTX_FORMAT_BC1 ? 8 : 16;
+}
+
+inline uint32_t KtxLevelBytes(uint32_t internalFormat, uint32_t width, uint32_t height)
+{
+    return ((width + 3) / 4) * ((height + 3) / 4) * KtxBlockBytes(internalFormat);
+}
+#endif
@@ -0,0 +1,55 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <string>
+
+// read only memory mapping of a whole file, unmapped when it goes out of scope
+class MappedFile
+{
+public:
+    const char *data = nullptr;
+    size_t size = 0;
+
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile()
+    {
+        unmap();
+    }
+
+    bool map(const std::string &path)
+    {
+        unmap();
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            return false;
+        }
+        void *address = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd); // the mapping keeps its own reference to the file
+        if (address == MAP_FAILED)
+            return false;
+        data = (const char *) address;
+        size = st.st_size;
+        return true;
+    }
+
+    void unmap()
+    {
+        if (data)
+            munmap((void *) data, size);
+        data = nullptr;
+        size = 0;
+    }
+};
+#endif
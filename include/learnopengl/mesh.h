@@ -5,10 +5,19 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 
+#include <learnopengl/frustum.h>
+#include <learnopengl/gl_state_cache.h>
 #include <learnopengl/shader.h>
+#include <learnopengl/texture_cache.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
 #include <string>
+#include <utility>
 #include <vector>
 using namespace std;
 
@@ -25,14 +34,57 @@ struct Vertex {
     glm::vec3 Bitangent;
 };
 
+// With the packed vertex format a Vertex is uploaded as 20 bytes in two streams. The position stream is all
+// a depth only pass fetches: the position as 16 bit normalized integers within the mesh's bounds, which the
+// vertex shaders map back with the positionOffset and positionScale uniforms (Mesh::BindVertexFormat).
+struct PackedPosition {
+    uint16_t x, y, z;
+    uint16_t padding; // keeps the stream 4 byte aligned
+};
+
+// the rest of it: normal and tangent as GL_INT_2_10_10_10_REV, the tangent's w is the sign of the bitangent
+// (cross(normal, tangent) * w), and the texture coordinates as half floats
+struct PackedAttributes {
+    uint32_t normal;
+    uint32_t tangent;
+    uint32_t texCoords;
+};
+
+static_assert(sizeof(PackedPosition) + sizeof(PackedAttributes) == 20, "a packed vertex is 20 bytes");
+
+enum VertexFormat {
+    FLOAT_VERTICES,  // Vertex as it is, plus a float position stream for depth only passes
+    PACKED_VERTICES  // PackedPosition + PackedAttributes
+};
 
 
 struct Texture {
-    unsigned int id;
+    unsigned int id; // as returned by TextureCache::Acquire, bound through TextureCache::Resolve
     string type;
     string path;
 };
 
+// CPU side mesh as produced by the importer/mesh cache, before anything is uploaded to the GPU.
+// vertices/indices point either into the storage vectors below or into a memory mapped mesh cache,
+// which is why MeshData can only be moved (moving a vector keeps its buffer where it is).
+// only type and path of the textures are filled in, loading them is left to the Model.
+struct MeshData {
+    const Vertex *vertices = nullptr;
+    size_t vertexCount = 0;
+    const unsigned int *indices = nullptr;
+    size_t indexCount = 0;
+    vector<Texture> textures;
+
+    vector<Vertex> vertexStorage;
+    vector<unsigned int> indexStorage;
+
+    MeshData() = default;
+    MeshData(const MeshData &) = delete;
+    MeshData &operator=(const MeshData &) = delete;
+    MeshData(MeshData &&) = default;
+    MeshData &operator=(MeshData &&) = default;
+};
+
 class Mesh {
 public:
     // mesh Data
@@ -41,7 +93,42 @@ public:
     vector<Texture>      textures;
 
     unsigned int VAO;
-    std::string glslIdentifierPrefix;
+    // positions only, in a buffer of their own, for depth only passes
+    unsigned int depthVAO;
+    unsigned int indexCount;
+    // axis aligned bounds of the vertex positions, in model space
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    // bounding sphere around the center of the box, usually tighter than the box's corners
+    float boundsRadius;
+    // meshes with the same textures share an id, RenderQueue sorts by it
+    unsigned int materialId;
+    // layout of the vertex buffers, and for packed vertices what the shaders map the positions back with
+    VertexFormat vertexFormat;
+    unsigned int vertexCount;
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+    glm::vec3 positionScale = glm::vec3(1.0f);
+
+    // the format meshes created from now on are uploaded in
+    static VertexFormat &DefaultVertexFormat()
+    {
+        static VertexFormat format = PACKED_VERTICES;
+        return format;
+    }
+
+    // bytes a vertex takes in the vertex buffers, and what a lit and a depth only draw fetch of it
+    static unsigned int VertexBytes(VertexFormat format)
+    {
+        return format == PACKED_VERTICES ? sizeof(PackedPosition) + sizeof(PackedAttributes) : sizeof(Vertex) + sizeof(glm::vec3);
+    }
+
+    static unsigned int FetchBytes(VertexFormat format, bool depthOnly)
+    {
+        if (format == PACKED_VERTICES)
+            return depthOnly ? sizeof(PackedPosition) : sizeof(PackedPosition) + sizeof(PackedAttributes);
+        return depthOnly ? sizeof(glm::vec3) : sizeof(Vertex);
+    }
+
     // constructor
     Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
     {
@@ -50,23 +137,143 @@ public:
         this->textures = textures;
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size());
+    }
+
+    // constructor for vertex/index data that is owned by someone else (e.g. a memory mapped mesh cache).
+    // the data is handed straight to the GPU and no CPU side copy is kept.
+    Mesh(const Vertex *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount, vector<Texture> textures)
+    {
+        this->textures = textures;
+        setupMesh(vertexData, vertexCount, indexData, indexCount);
     }
 
     // render the mesh
     void Draw(Shader &shader)
     {
-        // bind appropriate textures
+        bindTextures(shader);
+        BindVertexFormat(shader);
+
+        // draw mesh
+        glBindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+
+        // always good practice to set everything back to defaults once configured.
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // model space bounds test, the frustum has to be built with this mesh's model matrix
+    bool IsVisible(const Frustum &frustum) const
+    {
+        return frustum.SphereVisible((boundsMin + boundsMax) * 0.5f, boundsRadius) && frustum.BoxVisible(boundsMin, boundsMax);
+    }
+
+    // render instanceCount copies of the mesh, per instance attributes have to be set up on the VAO by the caller
+    void DrawInstanced(Shader &shader, unsigned int instanceCount)
+    {
+        bindTextures(shader);
+        BindVertexFormat(shader);
+
+        glBindVertexArray(VAO);
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0, instanceCount);
+        glBindVertexArray(0);
+
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // binds the textures and points the shader's samplers at them through state, without resetting
+    // anything afterwards. used by RenderQueue, which calls it only when program or material change.
+    void BindMaterial(const Shader &shader, GLStateCache &state)
+    {
+        const vector<UniformHandle> &samplers = locationsOf(shader).samplers;
+        for (unsigned int i = 0; i < textures.size(); i++)
+        {
+            shader.setInt(samplers[i], i);
+            state.BindTexture(i, TextureCache::Get().Resolve(textures[i].id));
+        }
+    }
+
+    // sets the uniforms the vertex shader turns the stored positions back into model space with, for float
+    // vertices too, the shader doesn't know the format. the program has to be in use.
+    void BindVertexFormat(const Shader &shader)
+    {
+        const ProgramLocations &locations = locationsOf(shader);
+        shader.setVec3(locations.positionOffset, positionOffset);
+        shader.setVec3(locations.positionScale, positionScale);
+    }
+
+    // depth only: no textures, and only the position stream is fetched. the shader has to be in use.
+    void DrawDepth(const Shader &shader)
+    {
+        BindVertexFormat(shader);
+        glBindVertexArray(depthVAO);
+        glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+    }
+
+    // per instance attributes have to be set up on depthVAO by the caller
+    void DrawDepthInstanced(const Shader &shader, unsigned int instanceCount)
+    {
+        BindVertexFormat(shader);
+        glBindVertexArray(depthVAO);
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0, instanceCount);
+        glBindVertexArray(0);
+    }
+
+    // prefix of the sampler names in the shader (e.g. "material.")
+    void SetGlslIdentifierPrefix(const std::string &prefix)
+    {
+        glslIdentifierPrefix = prefix;
+        programLocations.clear();
+    }
+
+private:
+    // render data
+    unsigned int VBO, EBO, positionVBO;
+    std::string glslIdentifierPrefix;
+
+    // sampler locations of the textures and the vertex format uniforms, per program the mesh was drawn with
+    struct ProgramLocations {
+        unsigned int program;
+        vector<UniformHandle> samplers;
+        UniformHandle positionOffset, positionScale;
+    };
+    vector<ProgramLocations> programLocations;
+
+    void bindTextures(const Shader &shader)
+    {
+        const vector<UniformHandle> &samplers = locationsOf(shader).samplers;
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
+            // set the sampler to the correct texture unit
+            shader.setInt(samplers[i], i);
+            // and finally bind the texture
+            glBindTexture(GL_TEXTURE_2D, TextureCache::Get().Resolve(textures[i].id));
+        }
+    }
+
+    const ProgramLocations &locationsOf(const Shader &shader)
+    {
+        for (const ProgramLocations &locations : programLocations)
+            if (locations.program == shader.ID)
+                return locations;
+
+        // first draw with this program: build the names once and resolve them
+        ProgramLocations locations;
+        locations.program = shader.ID;
+        locations.positionOffset = shader.uniform("positionOffset");
+        locations.positionScale = shader.uniform("positionScale");
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr   = 1;
         unsigned int heightNr   = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
+        for (const Texture &texture : textures)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
-            string name = textures[i].type;
+            const string &name = texture.type;
             if(name == "texture_diffuse")
                 number = std::to_string(diffuseNr++);
             else if(name == "texture_specular")
@@ -75,46 +282,86 @@ public:
                 number = std::to_string(normalNr++); // transfer unsigned int to stream
             else if(name == "texture_height")
                 number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            locations.samplers.push_back(shader.uniform(glslIdentifierPrefix + name + number));
         }
-
-
-
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+        programLocations.push_back(locations);
+        return programLocations.back();
     }
 
-private:
-    // render data
-    unsigned int VBO, EBO;
+    static unsigned int registerMaterial(const vector<Texture> &textures)
+    {
+        static map<vector<pair<unsigned int, string>>, unsigned int> materials;
+        vector<pair<unsigned int, string>> key;
+        for (const Texture &texture : textures)
+            key.push_back(make_pair(texture.id, texture.type));
+        auto found = materials.find(key);
+        if (found != materials.end())
+            return found->second;
+        unsigned int id = materials.size();
+        materials[key] = id;
+        return id;
+    }
 
     // initializes all the buffer objects/arrays
-    void setupMesh()
+    void setupMesh(const Vertex *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount)
     {
+        this->indexCount = indexCount;
+        materialId = registerMaterial(textures);
+        boundsMin = boundsMax = vertexCount > 0 ? vertexData[0].Position : glm::vec3(0.0f);
+        for (size_t i = 1; i < vertexCount; i++)
+        {
+            boundsMin = glm::min(boundsMin, vertexData[i].Position);
+            boundsMax = glm::max(boundsMax, vertexData[i].Position);
+        }
+        glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+        float radiusSquared = 0.0f;
+        for (size_t i = 0; i < vertexCount; i++)
+        {
+            glm::vec3 offset = vertexData[i].Position - center;
+            radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+        }
+        boundsRadius = std::sqrt(radiusSquared);
+
         // create buffers/arrays
+        vertexFormat = DefaultVertexFormat();
+        this->vertexCount = vertexCount;
         glGenVertexArrays(1, &VAO);
+        glGenVertexArrays(1, &depthVAO);
         glGenBuffers(1, &VBO);
+        glGenBuffers(1, &positionVBO);
         glGenBuffers(1, &EBO);
 
         glBindVertexArray(VAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indexData, GL_STATIC_DRAW);
+        if (vertexFormat == PACKED_VERTICES)
+            setupPackedVertices(vertexData, vertexCount);
+        else
+            setupFloatVertices(vertexData, vertexCount);
+
+        // the depth only passes read nothing but the position stream
+        glBindVertexArray(depthVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glEnableVertexAttribArray(0);
+        if (vertexFormat == PACKED_VERTICES)
+            glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedPosition), (void*)0);
+        else
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+
+        glBindVertexArray(0);
+    }
+
+    // VAO bound: the whole Vertex in VBO, and a copy of the positions in positionVBO for depth only passes,
+    // which then read 12 instead of sizeof(Vertex) bytes a vertex
+    void setupFloatVertices(const Vertex *vertexData, size_t vertexCount)
+    {
         // load data into vertex buffers
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         // A great thing about structs is that their memory layout is sequential for all its items.
         // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
         // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertexData, GL_STATIC_DRAW);
 
         // set the vertex attribute pointers
         // vertex Positions
@@ -133,7 +380,62 @@ private:
         glEnableVertexAttribArray(4);
         glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
 
-        glBindVertexArray(0);
+        vector<glm::vec3> positions(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++)
+            positions[i] = vertexData[i].Position;
+        glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+    }
+
+    // VAO bound: PackedPosition in positionVBO, PackedAttributes in VBO. the bounds have to be known, the
+    // positions are stored as fractions of them with 16 bits per axis.
+    void setupPackedVertices(const Vertex *vertexData, size_t vertexCount)
+    {
+        positionOffset = boundsMin;
+        positionScale = boundsMax - boundsMin;
+        glm::vec3 inverseScale(positionScale.x > 0.0f ? 1.0f / positionScale.x : 0.0f, positionScale.y > 0.0f ? 1.0f / positionScale.y : 0.0f,
+                               positionScale.z > 0.0f ? 1.0f / positionScale.z : 0.0f);
+        vector<PackedPosition> positions(vertexCount);
+        vector<PackedAttributes> attributes(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++)
+        {
+            const Vertex &vertex = vertexData[i];
+            glm::vec3 unit = (vertex.Position - positionOffset) * inverseScale;
+            positions[i] = {quantize(unit.x), quantize(unit.y), quantize(unit.z), 0};
+            // meshes without texture coordinates come with zero tangents
+            glm::vec3 normal = unitOr(vertex.Normal, glm::vec3(0.0f, 0.0f, 1.0f));
+            glm::vec3 tangent = unitOr(vertex.Tangent, glm::vec3(1.0f, 0.0f, 0.0f));
+            float handedness = glm::dot(glm::cross(normal, tangent), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+            attributes[i].normal = glm::packSnorm3x10_1x2(glm::vec4(normal, 0.0f));
+            attributes[i].tangent = glm::packSnorm3x10_1x2(glm::vec4(tangent, handedness));
+            attributes[i].texCoords = glm::packHalf2x16(vertex.TexCoords);
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(PackedPosition), positions.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedPosition), (void*)0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(PackedAttributes), attributes.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedAttributes), (void*)offsetof(PackedAttributes, normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedAttributes), (void*)offsetof(PackedAttributes, texCoords));
+        // no bitangent stream (location 4), it is rebuilt from the tangent's w
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedAttributes), (void*)offsetof(PackedAttributes, tangent));
+    }
+
+    static uint16_t quantize(float unit)
+    {
+        return (uint16_t) std::lround(std::max(0.0f, std::min(unit, 1.0f)) * 65535.0f);
+    }
+
+    static glm::vec3 unitOr(const glm::vec3 &v, const glm::vec3 &fallback)
+    {
+        float length = glm::length(v);
+        return length > 0.0f ? v / length : fallback;
     }
 };
 #endif
\ No newline at end of file
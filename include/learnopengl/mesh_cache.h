@@ -0,0 +1,298 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <learnopengl/mapped_file.h>
+#include <learnopengl/mesh.h>
+
+#include <sys/stat.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Binary cache of already imported and flattened meshes, so warm starts never have to go through Assimp.
+// The cache for a model lives next to it (<model path>.meshcache) and is only used when its header matches
+// the source path, size and modification time of the model and the post-processing flags it was imported with,
+// and the material libraries the model references (.mtl, which the texture paths come from) are unchanged.
+//
+// file layout (native endianness, every block starts 4 byte aligned):
+//   MeshCacheHeader
+//   source path                                       header.pathLength bytes
+//   dependencies                                      header.dependencyCount x ([u32 length][path] MeshCacheDependency)
+//   for every mesh:
+//     MeshCacheEntry
+//     textures                                        entry.textureCount x ([u32 length][type] [u32 length][path])
+//     vertices                                        entry.vertexCount x Vertex
+//     indices                                         entry.indexCount x unsigned int
+const uint32_t MESH_CACHE_VERSION = 2;
+
+struct MeshCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t vertexSize;
+    uint32_t postProcessFlags;
+    uint64_t sourceSize;
+    int64_t sourceModificationTime;
+    uint32_t pathLength;
+    uint32_t meshCount;
+    uint32_t dependencyCount;
+    uint32_t reserved;
+};
+
+// size and modification time of a file the import read besides the model itself, size is ~0 if it was missing
+struct MeshCacheDependency {
+    uint64_t size;
+    int64_t modificationTime;
+};
+
+struct MeshCacheEntry {
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t textureCount;
+    uint32_t reserved;
+};
+
+class MeshCache
+{
+public:
+    // memory mapping of a cache file, meshes loaded from it point into it
+    typedef MappedFile Mapping;
+
+    static string PathFor(const string &sourcePath)
+    {
+        return sourcePath + ".meshcache";
+    }
+
+    // maps the cache of the given model and fills meshes with views into it, so the mapping has to outlive them.
+    // returns false if there is no cache or it is stale/corrupt, meshes are left empty in that case.
+    static bool Load(const string &sourcePath, unsigned int postProcessFlags, Mapping &mapping, vector<MeshData> &meshes)
+    {
+        meshes.clear();
+        MeshCacheHeader expected;
+        if (!makeHeader(sourcePath, postProcessFlags, expected))
+            return false;
+        if (!mapping.map(PathFor(sourcePath)))
+            return false;
+
+        Reader reader{mapping.data, mapping.data + mapping.size};
+        const MeshCacheHeader *header = reader.take<MeshCacheHeader>(1);
+        if (!header || memcmp(header->magic, expected.magic, 4) != 0
+            || header->version != expected.version
+            || header->vertexSize != expected.vertexSize
+            || header->postProcessFlags != expected.postProcessFlags
+            || header->sourceSize != expected.sourceSize
+            || header->sourceModificationTime != expected.sourceModificationTime
+            || header->pathLength != sourcePath.size()) {
+            mapping.unmap();
+            return false;
+        }
+        const char *path = reader.take<char>(header->pathLength);
+        if (!path || sourcePath.compare(0, string::npos, path, header->pathLength) != 0) {
+            mapping.unmap();
+            return false;
+        }
+        for (uint32_t i = 0; i < header->dependencyCount; i++) {
+            string dependencyPath;
+            const MeshCacheDependency *dependency = reader.takeString(dependencyPath) ? reader.take<MeshCacheDependency>(1) : nullptr;
+            MeshCacheDependency current = stamp(dependencyPath);
+            if (!dependency || dependency->size != current.size || dependency->modificationTime != current.modificationTime) {
+                mapping.unmap();
+                return false;
+            }
+        }
+
+        meshes.reserve(header->meshCount);
+        for (uint32_t i = 0; i < header->meshCount; i++) {
+            const MeshCacheEntry *entry = reader.take<MeshCacheEntry>(1);
+            if (!entry) {
+                break;
+            }
+            MeshData mesh;
+            bool ok = true;
+            for (uint32_t t = 0; t < entry->textureCount && ok; t++) {
+                Texture texture;
+                texture.id = 0;
+                ok = reader.takeString(texture.type) && reader.takeString(texture.path);
+                mesh.textures.push_back(texture);
+            }
+            mesh.vertexCount = entry->vertexCount;
+            mesh.vertices = reader.take<Vertex>(entry->vertexCount);
+            mesh.indexCount = entry->indexCount;
+            mesh.indices = reader.take<unsigned int>(entry->indexCount);
+            if (!ok || !mesh.vertices || !mesh.indices || !indicesInRange(mesh))
+                break;
+            meshes.push_back(std::move(mesh));
+        }
+
+        if (meshes.size() != header->meshCount) {
+            cout << "WARNING::MESH_CACHE:: corrupt cache file " << PathFor(sourcePath) << endl;
+            meshes.clear();
+            mapping.unmap();
+            return false;
+        }
+        return true;
+    }
+
+    // writes the cache for the given model. the file is written under a temporary name and renamed
+    // when complete, so a crash half way through never leaves a truncated cache behind.
+    static bool Store(const string &sourcePath, unsigned int postProcessFlags, const vector<MeshData> &meshes)
+    {
+        MeshCacheHeader header;
+        if (!makeHeader(sourcePath, postProcessFlags, header))
+            return false;
+        header.meshCount = meshes.size();
+        vector<string> dependencies = materialLibraries(sourcePath);
+        header.dependencyCount = dependencies.size();
+
+        string cachePath = PathFor(sourcePath);
+        string temporaryPath = cachePath + ".tmp";
+        {
+            ofstream out(temporaryPath, ios::binary | ios::trunc);
+            if (!out) {
+                cout << "WARNING::MESH_CACHE:: can't write " << temporaryPath << endl;
+                return false;
+            }
+            Writer writer{out};
+            writer.put(&header, 1);
+            writer.put(sourcePath.data(), sourcePath.size());
+            for (const string &dependency : dependencies) {
+                MeshCacheDependency current = stamp(dependency);
+                writer.putString(dependency);
+                writer.put(&current, 1);
+            }
+            for (const MeshData &mesh : meshes) {
+                MeshCacheEntry entry;
+                entry.vertexCount = mesh.vertexCount;
+                entry.indexCount = mesh.indexCount;
+                entry.textureCount = mesh.textures.size();
+                entry.reserved = 0;
+                writer.put(&entry, 1);
+                for (const Texture &texture : mesh.textures) {
+                    writer.putString(texture.type);
+                    writer.putString(texture.path);
+                }
+                writer.put(mesh.vertices, mesh.vertexCount);
+                writer.put(mesh.indices, mesh.indexCount);
+            }
+            if (!out) {
+                out.close();
+                remove(temporaryPath.c_str());
+                return false;
+            }
+        }
+        return rename(temporaryPath.c_str(), cachePath.c_str()) == 0;
+    }
+
+private:
+    static bool makeHeader(const string &sourcePath, unsigned int postProcessFlags, MeshCacheHeader &header)
+    {
+        struct stat st;
+        if (stat(sourcePath.c_str(), &st) != 0)
+            return false;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "MSHC", 4);
+        header.version = MESH_CACHE_VERSION;
+        header.vertexSize = sizeof(Vertex);
+        header.postProcessFlags = postProcessFlags;
+        header.sourceSize = st.st_size;
+        header.sourceModificationTime = st.st_mtime;
+        header.pathLength = sourcePath.size();
+        return true;
+    }
+
+    static MeshCacheDependency stamp(const string &path)
+    {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+            return MeshCacheDependency{~(uint64_t) 0, 0};
+        return MeshCacheDependency{(uint64_t) st.st_size, (int64_t) st.st_mtime};
+    }
+
+    // the material libraries (mtllib lines) of an .obj, relative to its directory. other formats have none we know of.
+    static vector<string> materialLibraries(const string &sourcePath)
+    {
+        vector<string> libraries;
+        size_t extension = sourcePath.find_last_of('.');
+        if (extension == string::npos || sourcePath.compare(extension, string::npos, ".obj") != 0)
+            return libraries;
+        string directory = sourcePath.substr(0, sourcePath.find_last_of('/') + 1);
+        ifstream in(sourcePath);
+        string line;
+        while (getline(in, line)) {
+            istringstream words(line);
+            string keyword, library;
+            if (!(words >> keyword) || keyword != "mtllib")
+                continue;
+            while (words >> library)
+                libraries.push_back(directory + library);
+        }
+        return libraries;
+    }
+
+    // a corrupt file must not turn into a draw call reading past the vertex buffer
+    static bool indicesInRange(const MeshData &mesh)
+    {
+        for (size_t i = 0; i < mesh.indexCount; i++) {
+            if (mesh.indices[i] >= mesh.vertexCount)
+                return false;
+        }
+        return true;
+    }
+
+    static size_t padding(size_t size)
+    {
+        return (4 - size % 4) % 4;
+    }
+
+    struct Reader {
+        const char *cursor;
+        const char *end;
+
+        template<typename T>
+        const T *take(size_t count)
+        {
+            size_t bytes = count * sizeof(T);
+            if ((size_t) (end - cursor) < bytes + padding(bytes))
+                return nullptr;
+            const T *result = (const T *) cursor;
+            cursor += bytes + padding(bytes);
+            return result;
+        }
+
+        bool takeString(string &result)
+        {
+            const uint32_t *length = take<uint32_t>(1);
+            const char *characters = length ? take<char>(*length) : nullptr;
+            if (!characters)
+                return false;
+            result.assign(characters, *length);
+            return true;
+        }
+    };
+
+    struct Writer {
+        ofstream &out;
+
+        template<typename T>
+        void put(const T *data, size_t count)
+        {
+            static const char zeros[4] = {0, 0, 0, 0};
+            size_t bytes = count * sizeof(T);
+            out.write((const char *) data, bytes);
+            out.write(zeros, padding(bytes));
+        }
+
+        void putString(const string &value)
+        {
+            uint32_t length = value.size();
+            put(&length, 1);
+            put(value.data(), value.size());
+        }
+    };
+};
+#endif
@@ -0,0 +1,205 @@
+#ifndef MODEL_LOADER_H
+#define MODEL_LOADER_H
+
+#include <glm/glm.hpp>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <learnopengl/cpu_profiler.h>
+#include <learnopengl/mesh.h>
+#include <learnopengl/mesh_cache.h>
+#include <learnopengl/thread_pool.h>
+
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+// everything the importer knows about a model, without any OpenGL objects.
+// turned into a drawable Model on the GL thread.
+struct ModelData {
+    string path;
+    string directory;
+    vector<MeshData> meshes;
+    // keeps the mesh cache mapped while the meshes point into it
+    shared_ptr<MeshCache::Mapping> cache;
+    bool loaded = false;
+};
+
+// Reads models from disk (mesh cache or Assimp) and flattens them into ModelData.
+// None of this touches OpenGL, so it can run on worker threads; only the upload in the Model
+// constructor has to happen on the GL thread.
+class ModelLoader
+{
+public:
+    static const unsigned int postProcessFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+    // imports the model on the calling thread
+    static ModelData load(string const &path)
+    {
+        PROFILE_SCOPE("Model import");
+        ModelData data;
+        data.path = path;
+        // retrieve the directory path of the filepath
+        data.directory = path.substr(0, path.find_last_of('/'));
+
+        // warm start: point the meshes straight into the mapped cache file
+        data.cache = make_shared<MeshCache::Mapping>();
+        if (MeshCache::Load(path, postProcessFlags, *data.cache, data.meshes))
+        {
+            data.loaded = true;
+            return data;
+        }
+        data.cache.reset();
+
+        // read file via ASSIMP
+        Assimp::Importer importer;
+        const aiScene* scene = importer.ReadFile(path, postProcessFlags);
+        // check for errors
+        if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+        {
+            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+            return data;
+        }
+
+        // process ASSIMP's root node recursively
+        processNode(scene->mRootNode, scene, data.meshes);
+        data.loaded = true;
+
+        // cold start: remember the result for the next run
+        if (!MeshCache::Store(path, postProcessFlags, data.meshes))
+            cout << "WARNING::MESH_CACHE:: failed to write cache for " << path << endl;
+        return data;
+    }
+
+    // imports the model on the shared worker pool
+    static future<ModelData> loadAsync(string const &path)
+    {
+        return WorkerPool().enqueue([path] { return load(path); });
+    }
+
+private:
+    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
+    static void processNode(aiNode *node, const aiScene *scene, vector<MeshData> &meshes)
+    {
+        // process each mesh located at the current node
+        for(unsigned int i = 0; i < node->mNumMeshes; i++)
+        {
+            // the node object only contains indices to index the actual objects in the scene.
+            // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
+            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+            meshes.push_back(processMesh(mesh, scene));
+        }
+        // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
+        for(unsigned int i = 0; i < node->mNumChildren; i++)
+        {
+            processNode(node->mChildren[i], scene, meshes);
+        }
+
+    }
+
+    static MeshData processMesh(aiMesh *mesh, const aiScene *scene)
+    {
+        // data to fill
+        MeshData data;
+        vector<Vertex> &vertices = data.vertexStorage;
+        vector<unsigned int> &indices = data.indexStorage;
+        vertices.reserve(mesh->mNumVertices);
+
+        // walk through each of the mesh's vertices
+        for(unsigned int i = 0; i < mesh->mNumVertices; i++)
+        {
+            Vertex vertex;
+            glm::vec3 vector; // we declare a placeholder vector since assimp_ uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
+            // positions
+            vector.x = mesh->mVertices[i].x;
+            vector.y = mesh->mVertices[i].y;
+            vector.z = mesh->mVertices[i].z;
+            vertex.Position = vector;
+            // normals
+            if (mesh->HasNormals())
+            {
+                vector.x = mesh->mNormals[i].x;
+                vector.y = mesh->mNormals[i].y;
+                vector.z = mesh->mNormals[i].z;
+                vertex.Normal = vector;
+            }
+            // texture coordinates
+            if(mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+            {
+                glm::vec2 vec;
+                // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't
+                // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
+                vec.x = mesh->mTextureCoords[0][i].x;
+                vec.y = mesh->mTextureCoords[0][i].y;
+                vertex.TexCoords = vec;
+                // tangent
+                vector.x = mesh->mTangents[i].x;
+                vector.y = mesh->mTangents[i].y;
+                vector.z = mesh->mTangents[i].z;
+                vertex.Tangent = vector;
+                // bitangent
+                vector.x = mesh->mBitangents[i].x;
+                vector.y = mesh->mBitangents[i].y;
+                vector.z = mesh->mBitangents[i].z;
+                vertex.Bitangent = vector;
+            }
+            else
+                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+
+            vertices.push_back(vertex);
+
+
+        }
+        // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+        for(unsigned int i = 0; i < mesh->mNumFaces; i++)
+        {
+            aiFace face = mesh->mFaces[i];
+            // retrieve all indices of the face and store them in the indices vector
+            for(unsigned int j = 0; j < face.mNumIndices; j++)
+                indices.push_back(face.mIndices[j]);
+        }
+        // process materials
+        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+        // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
+        // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER.
+        // Same applies to other texture as the following list summarizes:
+        // diffuse: texture_diffuseN
+        // specular: texture_specularN
+        // normal: texture_normalN
+
+        // 1. diffuse maps
+        materialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", data.textures);
+        // 2. specular maps
+        materialTextures(material, aiTextureType_SPECULAR, "texture_specular", data.textures);
+        // 3. normal maps
+        materialTextures(material, aiTextureType_HEIGHT, "texture_normal", data.textures);
+        // 4. height maps
+        materialTextures(material, aiTextureType_AMBIENT, "texture_height", data.textures);
+
+        data.vertices = vertices.data();
+        data.vertexCount = vertices.size();
+        data.indices = indices.data();
+        data.indexCount = indices.size();
+        return data;
+    }
+
+    // collects the paths of all material textures of a given type, they are loaded later by the Model.
+    static void materialTextures(aiMaterial *mat, aiTextureType type, string typeName, vector<Texture> &textures)
+    {
+        for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+        {
+            aiString str;
+            mat->GetTexture(type, i, &str);
+            Texture texture;
+            texture.id = 0;
+            texture.type = typeName;
+            texture.path = str.C_Str();
+            textures.push_back(texture);
+        }
+    }
+};
+#endif
@@ -0,0 +1,192 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/cpu_profiler.h>
+#include <learnopengl/gl_state_cache.h>
+#include <learnopengl/mesh.h>
+#include <learnopengl/shader.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+// one mesh draw, as collected by RenderQueue
+struct DrawItem {
+    Shader *shader = nullptr;
+    Mesh *mesh = nullptr;
+    unsigned int instanceCount = 0; // 0 draws a single mesh, otherwise instanced (attributes are up to the caller)
+    // per draw uniforms, skipped when invalid. model has to stay alive until Submit.
+    UniformHandle modelUniform;
+    const glm::mat4 *model = nullptr;
+    UniformHandle paramUniform;
+    glm::vec4 param;
+    float viewDepth = 0.0f; // distance in front of the camera
+};
+
+// Collects the frame's draws, sorts them by a 64 bit key and submits them through a GLStateCache.
+//
+// A color queue sorts by program, then material (the mesh's textures), then vertex array, then front to
+// back, so every state is set as rarely as possible and the cache skips what is already bound. A depth
+// only queue has no materials and sorts front to back right after the program, which is what early
+// depth testing wants. Keys are sorted with an LSD radix sort, 8 bits per pass, skipping bytes that are
+// equal in all keys.
+class RenderQueue
+{
+public:
+    explicit RenderQueue(bool depthOnly = false) : depthOnly(depthOnly)
+    {
+    }
+
+    // starts a frame, view is the camera's view matrix used to compute the depth of the draws
+    void Begin(const glm::mat4 &view, float farPlane)
+    {
+        this->view = view;
+        this->farPlane = farPlane;
+        items.clear();
+        keys.clear();
+    }
+
+    // a mesh drawn with model as its model matrix (set through modelUniform)
+    void Add(Shader &shader, Mesh &mesh, const glm::mat4 &model, UniformHandle modelUniform)
+    {
+        DrawItem item;
+        item.shader = &shader;
+        item.mesh = &mesh;
+        item.model = &model;
+        item.modelUniform = modelUniform;
+        item.viewDepth = ViewDepth(model, (mesh.boundsMin + mesh.boundsMax) * 0.5f);
+        Add(item);
+    }
+
+    // distance of a point in model space in front of the camera, for DrawItem::viewDepth
+    float ViewDepth(const glm::mat4 &model, const glm::vec3 &point) const
+    {
+        return -(view * model * glm::vec4(point, 1.0f)).z;
+    }
+
+    void Add(const DrawItem &item)
+    {
+        keys.push_back({makeKey(item), (uint32_t) items.size()});
+        items.push_back(item);
+    }
+
+    // sorts and draws everything added since Begin. the bindings the queue leaves behind are undefined
+    // for other code, except that vertex array 0 and texture unit 0 are active.
+    void Submit()
+    {
+        PROFILE_SCOPE("RenderQueue submit");
+        sortKeys();
+        state.Invalidate();
+        const Shader *shader = nullptr;
+        unsigned int material = ~0u;
+        const glm::mat4 *model = nullptr;
+        const Mesh *mesh = nullptr;
+        for (const SortKey &key : keys) {
+            const DrawItem &item = items[key.item];
+            if (item.shader != shader) {
+                shader = item.shader;
+                state.UseProgram(shader->ID);
+                material = ~0u;
+                model = nullptr;
+                mesh = nullptr;
+            }
+            if (!depthOnly && item.mesh->materialId != material) {
+                material = item.mesh->materialId;
+                item.mesh->BindMaterial(*shader, state);
+            }
+            if (item.modelUniform.valid() && item.model != model) {
+                model = item.model;
+                shader->setMat4(item.modelUniform, *model);
+            }
+            if (item.mesh != mesh) {
+                mesh = item.mesh;
+                item.mesh->BindVertexFormat(*shader);
+            }
+            if (item.paramUniform.valid())
+                shader->setVec4(item.paramUniform, item.param);
+
+            state.BindVertexArray(depthOnly ? item.mesh->depthVAO : item.mesh->VAO);
+            if (item.instanceCount > 0)
+                glDrawElementsInstanced(GL_TRIANGLES, item.mesh->indexCount, GL_UNSIGNED_INT, 0, item.instanceCount);
+            else
+                glDrawElements(GL_TRIANGLES, item.mesh->indexCount, GL_UNSIGNED_INT, 0);
+            state.stats.drawCalls++;
+        }
+        state.BindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    size_t Size() const
+    {
+        return items.size();
+    }
+
+    // calls made and skipped by the submits since the last ResetStats
+    const GLStateCache::Stats &Stats() const
+    {
+        return state.stats;
+    }
+
+    void ResetStats()
+    {
+        state.stats.reset();
+    }
+
+private:
+    struct SortKey {
+        uint64_t key;
+        uint32_t item;
+    };
+
+    bool depthOnly;
+    glm::mat4 view;
+    float farPlane = 100.0f;
+    vector<DrawItem> items;
+    vector<SortKey> keys, scratch;
+    vector<unsigned int> programs; // program IDs in the order they were first seen, for an 8 bit index
+    GLStateCache state;
+
+    unsigned int programIndex(unsigned int id)
+    {
+        for (unsigned int i = 0; i < programs.size(); i++)
+            if (programs[i] == id)
+                return i;
+        programs.push_back(id);
+        return programs.size() - 1;
+    }
+
+    //   color:      program (8) | material (16) | vertex array (16) | depth (24)
+    //   depth only: program (8) | depth (24)    | vertex array (16) | 0 (16)
+    uint64_t makeKey(const DrawItem &item)
+    {
+        uint64_t program = programIndex(item.shader->ID) & 0xFF;
+        uint64_t depth = (uint64_t) (glm::clamp(item.viewDepth / farPlane, 0.0f, 1.0f) * 0xFFFFFF);
+        uint64_t vertexArray = (depthOnly ? item.mesh->depthVAO : item.mesh->VAO) & 0xFFFF;
+        if (depthOnly)
+            return program << 56 | depth << 32 | vertexArray << 16;
+        uint64_t material = item.mesh->materialId & 0xFFFF;
+        return program << 56 | material << 40 | vertexArray << 24 | depth;
+    }
+
+    void sortKeys()
+    {
+        scratch.resize(keys.size());
+        for (int shift = 0; shift < 64; shift += 8) {
+            size_t counts[257] = {0};
+            for (const SortKey &key : keys)
+                counts[((key.key >> shift) & 0xFF) + 1]++;
+            if (std::count(counts + 1, counts + 257, (size_t) 0) >= 255)
+                continue; // the same byte everywhere, this pass wouldn't move anything
+            for (int i = 1; i < 257; i++)
+                counts[i] += counts[i - 1];
+            for (const SortKey &key : keys)
+                scratch[counts[(key.key >> shift) & 0xFF]++] = key;
+            keys.swap(scratch);
+        }
+    }
+};
+#endif
@@ -0,0 +1,333 @@
+#ifndef RENDER_TARGETS_H
+#define RENDER_TARGETS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+// how the texture of a render target is allocated
+struct TargetFormat {
+    GLenum internalFormat;
+    GLenum format;
+    GLenum type;
+    GLenum filter;
+
+    bool operator==(const TargetFormat &other) const
+    {
+        return internalFormat == other.internalFormat && format == other.format && type == other.type && filter == other.filter;
+    }
+};
+
+// Owns the textures and framebuffers the frame is rendered through, sized after the window's framebuffer.
+//
+// Persistent targets (the scene's color and depth, the G-buffer) are registered once and referred to by
+// handle. Resize() only records the new size: a texture is reallocated the next time it is asked for, and
+// a framebuffer brings all its attachments up to date before it is returned, so a window dragged through
+// a hundred sizes costs one reallocation when the next frame is drawn. The GL names stay the same across
+// reallocations, attachments don't have to be redone.
+//
+// The scene can be drawn at a lower resolution without reallocating anything: with a render scale below 1
+// BindFramebuffer() only covers that part of the targets, from the bottom left corner, and passes that read
+// them scale their texture coordinates by UVScale().
+//
+// Transient targets are for passes that only need a texture until the end of the frame (the bloom chain):
+// Acquire() hands out a free pooled texture of the same format and size, or makes one, and Release() puts
+// it back. Pooled textures nobody asked for in a while, like the ones of the old size after a resize, are
+// freed by EndFrame().
+class RenderTargets
+{
+public:
+    struct TextureHandle {
+        int index = -1;
+    };
+
+    struct FramebufferHandle {
+        int index = -1;
+    };
+
+    // GPU memory of the targets, estimated from their formats
+    struct MemoryStats {
+        size_t persistentBytes = 0;
+        size_t poolBytes = 0;
+        unsigned int pooledTextures = 0;
+        unsigned int pooledInUse = 0;
+        unsigned int reallocations = 0; // of persistent textures, since the start
+    };
+
+    // frames a pooled texture can stay unused before EndFrame frees it
+    static const unsigned int POOL_MAX_IDLE_FRAMES = 120;
+
+    RenderTargets(unsigned int width, unsigned int height)
+    {
+        Resize(width, height);
+    }
+
+    ~RenderTargets()
+    {
+        for (TextureEntry &texture : textures)
+            glDeleteTextures(1, &texture.ID);
+        for (FramebufferEntry &framebuffer : framebuffers)
+            glDeleteFramebuffers(1, &framebuffer.ID);
+        for (PooledTexture &pooled : pool)
+            glDeleteTextures(1, &pooled.ID);
+    }
+
+    RenderTargets(const RenderTargets &) = delete;
+    RenderTargets &operator=(const RenderTargets &) = delete;
+
+    // the size the persistent targets have from now on, nothing is reallocated yet. 0 (a minimized window)
+    // keeps the old size.
+    void Resize(unsigned int width, unsigned int height)
+    {
+        if (width > 0 && height > 0)
+            size = glm::ivec2(width, height);
+    }
+
+    glm::ivec2 Size() const
+    {
+        return size;
+    }
+
+    // the part of the targets drawn to, in each dimension (0, 1]
+    void SetRenderScale(float scale)
+    {
+        renderScale = std::max(0.01f, std::min(scale, 1.0f));
+    }
+
+    float RenderScale() const
+    {
+        return renderScale;
+    }
+
+    // pixels actually drawn of a full size target
+    glm::ivec2 RenderSize() const
+    {
+        return scaledSize(renderScale);
+    }
+
+    // multiplies texture coordinates of a full size target to stay within RenderSize()
+    glm::vec2 UVScale() const
+    {
+        glm::ivec2 render = RenderSize();
+        return glm::vec2((float) render.x / size.x, (float) render.y / size.y);
+    }
+
+    // a texture that lives as long as the manager, scale times the size in each dimension
+    TextureHandle AddTexture(const TargetFormat &format, float scale = 1.0f)
+    {
+        TextureEntry texture;
+        texture.format = format;
+        texture.scale = scale;
+        glGenTextures(1, &texture.ID);
+        textures.push_back(texture);
+        TextureHandle handle;
+        handle.index = (int) textures.size() - 1;
+        return handle;
+    }
+
+    // a framebuffer of persistent textures, colors attached in order. all of them are drawn to until the
+    // caller changes glDrawBuffers.
+    FramebufferHandle AddFramebuffer(std::initializer_list<TextureHandle> colors)
+    {
+        return AddFramebuffer(colors, TextureHandle());
+    }
+
+    // the same with a depth texture, its format decides between the depth and depth-stencil attachment
+    FramebufferHandle AddFramebuffer(std::initializer_list<TextureHandle> colors, TextureHandle depth)
+    {
+        FramebufferEntry framebuffer;
+        framebuffer.colors.assign(colors.begin(), colors.end());
+        framebuffer.depth = depth;
+        glGenFramebuffers(1, &framebuffer.ID);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.ID);
+        vector<GLenum> drawBuffers;
+        for (unsigned int i = 0; i < framebuffer.colors.size(); i++) {
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, Texture(framebuffer.colors[i]), 0);
+            drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + i);
+        }
+        if (depth.index >= 0) {
+            GLenum attachment = textures[depth.index].format.format == GL_DEPTH_STENCIL ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+            glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, Texture(depth), 0);
+        }
+        glDrawBuffers((GLsizei) drawBuffers.size(), drawBuffers.data());
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Render target framebuffer not complete!" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        framebuffers.push_back(framebuffer);
+        FramebufferHandle handle;
+        handle.index = (int) framebuffers.size() - 1;
+        return handle;
+    }
+
+    // GL name of the texture, reallocated first if the size changed since it was last used
+    unsigned int Texture(TextureHandle handle)
+    {
+        TextureEntry &texture = textures[handle.index];
+        glm::ivec2 wanted = scaledSize(texture.scale);
+        if (texture.allocated != wanted) {
+            if (texture.allocated != glm::ivec2(0))
+                stats.reallocations++;
+            allocate(texture.ID, texture.format, wanted);
+            texture.allocated = wanted;
+        }
+        return texture.ID;
+    }
+
+    glm::ivec2 TextureSize(TextureHandle handle) const
+    {
+        return scaledSize(textures[handle.index].scale);
+    }
+
+    // GL name of the framebuffer, with every attachment at the current size
+    unsigned int Framebuffer(FramebufferHandle handle)
+    {
+        const FramebufferEntry &framebuffer = framebuffers[handle.index];
+        for (TextureHandle color : framebuffer.colors)
+            Texture(color);
+        if (framebuffer.depth.index >= 0)
+            Texture(framebuffer.depth);
+        return framebuffer.ID;
+    }
+
+    // binds the framebuffer and sets the viewport to the render scale of its size (the size of its first
+    // attachment)
+    void BindFramebuffer(FramebufferHandle handle)
+    {
+        const FramebufferEntry &framebuffer = framebuffers[handle.index];
+        glBindFramebuffer(GL_FRAMEBUFFER, Framebuffer(handle));
+        glm::ivec2 viewport = framebuffer.colors.empty() ? TextureSize(framebuffer.depth) : TextureSize(framebuffer.colors[0]);
+        glViewport(0, 0, std::max(1, (int) std::lround(viewport.x * renderScale)), std::max(1, (int) std::lround(viewport.y * renderScale)));
+    }
+
+    // a texture for this frame's passes, pooled. give it back with Release when done.
+    unsigned int Acquire(const TargetFormat &format, glm::ivec2 textureSize)
+    {
+        textureSize = glm::ivec2(std::max(1, textureSize.x), std::max(1, textureSize.y));
+        for (PooledTexture &pooled : pool)
+            if (!pooled.inUse && pooled.size == textureSize && pooled.format == format) {
+                pooled.inUse = true;
+                pooled.lastUsedFrame = frame;
+                return pooled.ID;
+            }
+        PooledTexture pooled;
+        pooled.format = format;
+        pooled.size = textureSize;
+        pooled.inUse = true;
+        pooled.lastUsedFrame = frame;
+        glGenTextures(1, &pooled.ID);
+        allocate(pooled.ID, format, textureSize);
+        pool.push_back(pooled);
+        return pooled.ID;
+    }
+
+    void Release(unsigned int texture)
+    {
+        for (PooledTexture &pooled : pool)
+            if (pooled.ID == texture) {
+                pooled.inUse = false;
+                return;
+            }
+        std::cout << "RenderTargets::Release of a texture that isn't pooled" << std::endl;
+    }
+
+    // once per frame: frees the pooled textures that weren't acquired for POOL_MAX_IDLE_FRAMES
+    void EndFrame()
+    {
+        frame++;
+        for (size_t i = 0; i < pool.size();) {
+            if (!pool[i].inUse && frame - pool[i].lastUsedFrame > POOL_MAX_IDLE_FRAMES) {
+                glDeleteTextures(1, &pool[i].ID);
+                pool[i] = pool.back();
+                pool.pop_back();
+            } else {
+                i++;
+            }
+        }
+    }
+
+    MemoryStats GetMemoryStats() const
+    {
+        MemoryStats memory = stats;
+        for (const TextureEntry &texture : textures)
+            memory.persistentBytes += (size_t) texture.allocated.x * texture.allocated.y * bytesPerPixel(texture.format.internalFormat);
+        for (const PooledTexture &pooled : pool) {
+            memory.poolBytes += (size_t) pooled.size.x * pooled.size.y * bytesPerPixel(pooled.format.internalFormat);
+            memory.pooledTextures++;
+            if (pooled.inUse)
+                memory.pooledInUse++;
+        }
+        return memory;
+    }
+
+private:
+    struct TextureEntry {
+        unsigned int ID = 0;
+        TargetFormat format;
+        float scale = 1.0f;
+        glm::ivec2 allocated = glm::ivec2(0); // 0 until first used
+    };
+
+    struct FramebufferEntry {
+        unsigned int ID = 0;
+        vector<TextureHandle> colors;
+        TextureHandle depth;
+    };
+
+    struct PooledTexture {
+        unsigned int ID = 0;
+        TargetFormat format;
+        glm::ivec2 size;
+        bool inUse = false;
+        unsigned long long lastUsedFrame = 0;
+    };
+
+    glm::ivec2 size = glm::ivec2(1);
+    float renderScale = 1.0f;
+    vector<TextureEntry> textures;
+    vector<FramebufferEntry> framebuffers;
+    vector<PooledTexture> pool;
+    unsigned long long frame = 0;
+    MemoryStats stats;
+
+    glm::ivec2 scaledSize(float scale) const
+    {
+        return glm::ivec2(std::max(1, (int) std::lround(size.x * scale)), std::max(1, (int) std::lround(size.y * scale)));
+    }
+
+    static void allocate(unsigned int id, const TargetFormat &format, glm::ivec2 textureSize)
+    {
+        glBindTexture(GL_TEXTURE_2D, id);
+        glTexImage2D(GL_TEXTURE_2D, 0, format.internalFormat, textureSize.x, textureSize.y, 0, format.format, format.type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, format.filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, format.filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // what drivers typically store, depth 24 is padded to 32 bits
+    static size_t bytesPerPixel(GLenum internalFormat)
+    {
+        switch (internalFormat) {
+            case GL_R8:
+                return 1;
+            case GL_R16F:
+            case GL_RG8:
+                return 2;
+            case GL_RGBA16F:
+            case GL_RG32F:
+                return 8;
+            case GL_RGBA32F:
+                return 16;
+            default: // RGBA8, R11F_G11F_B10F, R32F, RG16F, the depth formats
+                return 4;
+        }
+    }
+};
+#endif
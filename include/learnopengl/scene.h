@@ -0,0 +1,188 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/bvh.h>
+#include <learnopengl/cpu_profiler.h>
+#include <learnopengl/frustum.h>
+#include <learnopengl/hiz_buffer.h>
+#include <learnopengl/model.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+// The placed models of the scene, with a BVH over the world space bounds of all their meshes.
+//
+// Culling, picking and proximity queries walk the tree instead of every mesh. Moving a model
+// (SetTransform) refits the tree in place, which is cheap enough to do every frame for a few objects.
+// Meshes that pass the frustum can also be tested against a HiZBuffer.
+// Models are referenced, they have to outlive the scene.
+class Scene
+{
+public:
+    struct PickResult {
+        unsigned int object = 0;
+        unsigned int mesh = 0;
+        float distance = 0.0f;
+    };
+
+    // places a model, returns the handle used by the other functions. models that can't be hidden
+    // (like one following the camera) should skip occlusion culling, its depth is always a frame old.
+    unsigned int Add(Model &model, const glm::mat4 &transform = glm::mat4(1.0f), bool occlusionCulled = true)
+    {
+        Entry entry;
+        entry.model = &model;
+        entry.occlusionCulled = occlusionCulled;
+        entry.transform = transform;
+        entry.inverseTransform = glm::inverse(transform);
+        entry.firstObject = meshes.size();
+        for (unsigned int i = 0; i < model.meshes.size(); i++)
+            meshes.push_back({(unsigned int) entries.size(), i});
+        entries.push_back(entry);
+
+        vector<Aabb> boxes;
+        boxes.reserve(meshes.size());
+        for (const MeshRef &mesh : meshes)
+            boxes.push_back(worldBounds(mesh));
+        bvh.Build(boxes);
+        return entries.size() - 1;
+    }
+
+    void SetTransform(unsigned int object, const glm::mat4 &transform)
+    {
+        Entry &entry = entries[object];
+        if (entry.transform == transform)
+            return;
+        entry.transform = transform;
+        entry.inverseTransform = glm::inverse(transform);
+        for (unsigned int i = 0; i < entry.model->meshes.size(); i++)
+            bvh.Update(entry.firstObject + i, worldBounds(meshes[entry.firstObject + i]));
+    }
+
+    const glm::mat4 &Transform(unsigned int object) const
+    {
+        return entries[object].transform;
+    }
+
+    Model &GetModel(unsigned int object) const
+    {
+        return *entries[object].model;
+    }
+
+    // finds the meshes inside the view frustum and, with occlusion, not hidden by its depth. see VisibleMeshes
+    void Cull(const glm::mat4 &viewProjection, CullingStats *stats = nullptr, const HiZBuffer *occlusion = nullptr)
+    {
+        PROFILE_SCOPE("Scene cull");
+        for (Entry &entry : entries) {
+            entry.visibleMeshes.clear();
+            entry.localFrustum = Frustum(viewProjection * entry.transform);
+            entry.occlusionTest = occlusion && entry.occlusionCulled ? occlusion->MakeTest(entry.transform) : HiZBuffer::Test();
+        }
+        bvh.QueryFrustum(Frustum(viewProjection), [&](uint32_t object, bool inside) {
+            const MeshRef &mesh = meshes[object];
+            Entry &entry = entries[mesh.entry];
+            // the world box is looser than the mesh's own bounds, test those unless the box is known inside
+            const Mesh &target = entry.model->meshes[mesh.mesh];
+            if (!inside && !target.IsVisible(entry.localFrustum))
+                return;
+            if (!entry.occlusionTest.BoxVisible(target.boundsMin, target.boundsMax)) {
+                if (stats)
+                    stats->meshesOccluded++;
+                return;
+            }
+            entry.visibleMeshes.push_back(mesh.mesh);
+        });
+        for (Entry &entry : entries) {
+            sort(entry.visibleMeshes.begin(), entry.visibleMeshes.end());
+            if (stats) {
+                stats->meshesTested += entry.model->meshes.size();
+                stats->meshesDrawn += entry.visibleMeshes.size();
+            }
+        }
+    }
+
+    // mesh indices of the object found visible by the last Cull, for Model::Draw
+    const vector<unsigned int> &VisibleMeshes(unsigned int object) const
+    {
+        return entries[object].visibleMeshes;
+    }
+
+    // calls visit(object, mesh) for every mesh inside the frustum of viewProjection, like Cull but without
+    // occlusion and without touching its results. used for the shadow casters of a light.
+    template<typename Visit>
+    void QueryFrustum(const glm::mat4 &viewProjection, Visit &&visit)
+    {
+        queryFrustums.resize(entries.size());
+        for (size_t i = 0; i < entries.size(); i++)
+            queryFrustums[i] = Frustum(viewProjection * entries[i].transform);
+        bvh.QueryFrustum(Frustum(viewProjection), [&](uint32_t object, bool inside) {
+            const MeshRef &mesh = meshes[object];
+            if (inside || entries[mesh.entry].model->meshes[mesh.mesh].IsVisible(queryFrustums[mesh.entry]))
+                visit(mesh.entry, mesh.mesh);
+        });
+    }
+
+    // nearest mesh whose bounds the ray hits (in the mesh's own space, so rotated models pick tightly)
+    bool Pick(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, PickResult &result) const
+    {
+        Bvh::RayHit hit;
+        bool found = bvh.Raycast(origin, direction, maxDistance, [&](uint32_t object, float maxT) {
+            const MeshRef &mesh = meshes[object];
+            const Entry &entry = entries[mesh.entry];
+            const Mesh &target = entry.model->meshes[mesh.mesh];
+            // an unnormalized local direction keeps the distances in world units
+            glm::vec3 localOrigin = glm::vec3(entry.inverseTransform * glm::vec4(origin, 1.0f));
+            glm::vec3 localDirection = glm::vec3(entry.inverseTransform * glm::vec4(direction, 0.0f));
+            return Bvh::rayBox(Aabb(target.boundsMin, target.boundsMax), localOrigin, glm::vec3(1.0f) / localDirection, maxT);
+        }, hit);
+        if (!found)
+            return false;
+        result.object = meshes[hit.object].entry;
+        result.mesh = meshes[hit.object].mesh;
+        result.distance = hit.distance;
+        return true;
+    }
+
+    // calls visit(object, mesh) for every mesh whose world bounds are closer than radius to center
+    template<typename Visit>
+    void Nearby(const glm::vec3 &center, float radius, Visit &&visit) const
+    {
+        bvh.QuerySphere(center, radius, [&](uint32_t object) {
+            visit(meshes[object].entry, meshes[object].mesh);
+        });
+    }
+
+private:
+    struct Entry {
+        Model *model;
+        glm::mat4 transform;
+        glm::mat4 inverseTransform;
+        unsigned int firstObject;
+        bool occlusionCulled;
+        Frustum localFrustum;
+        HiZBuffer::Test occlusionTest;
+        vector<unsigned int> visibleMeshes;
+    };
+
+    // one BVH object per mesh
+    struct MeshRef {
+        unsigned int entry;
+        unsigned int mesh;
+    };
+
+    vector<Entry> entries;
+    vector<MeshRef> meshes;
+    Bvh bvh;
+    vector<Frustum> queryFrustums; // scratch of QueryFrustum, per entry
+
+    Aabb worldBounds(const MeshRef &ref) const
+    {
+        const Entry &entry = entries[ref.entry];
+        const Mesh &mesh = entry.model->meshes[ref.mesh];
+        return Aabb::Transform(Aabb(mesh.boundsMin, mesh.boundsMax), entry.transform);
+    }
+};
+#endif
@@ -0,0 +1,255 @@
+#ifndef SHADOW_MAP_H
+#define SHADOW_MAP_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/cpu_profiler.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+using namespace std;
+
+// contents of the ShadowData uniform block (see newShader.fs), has to match its std140 layout
+struct ShadowData {
+    glm::mat4 lightSpace[4];  // world to the light's clip space, per cascade
+    glm::vec4 cascadeSplits;  // view space distance where each cascade ends
+    int cascadeCount;
+    float texelSize;          // 1 / resolution, the spacing of the PCF taps
+    int enabled;
+    float padding;
+};
+
+static_assert(sizeof(ShadowData) == 288, "ShadowData has to match the std140 layout");
+
+// Cascaded shadow maps for a directional light.
+//
+// The camera's view distance is split into cascades, closer ones covering less space so the shadow texels
+// on screen stay about the same size. Every cascade is an orthographic view along the light that encloses
+// the bounding sphere of its slice of the camera frustum; a sphere doesn't change with the camera's rotation,
+// and its position is snapped to whole shadow texels, so the shadow edges don't shimmer while the camera
+// moves. The cascades are layers of one depth texture array, sampled with hardware depth comparison.
+//
+// Rendering the casters is up to the caller: Update() once per frame, then for every cascade BeginCascade(),
+// draw with View(i)/Projection(i) (culling against ViewProjection(i)), and End().
+class ShadowMap
+{
+public:
+    static const unsigned int MAX_CASCADES = 4;
+
+    struct Settings {
+        unsigned int resolution = 2048;
+        unsigned int cascadeCount = 4;
+        float maxDistance = 100.0f;  // no shadows further away from the camera
+        float splitLambda = 0.8f;    // 0: evenly spaced cascades, 1: logarithmic
+        float casterDistance = 100.0f; // how far behind a cascade (towards the light) casters are still drawn
+        float slopeBias = 2.0f;      // glPolygonOffset while rendering the casters
+        float constantBias = 4.0f;
+    };
+
+    unsigned int ID = 0; // GL_TEXTURE_2D_ARRAY of depth, one layer per cascade
+
+    ShadowMap() : ShadowMap(Settings())
+    {
+    }
+
+    explicit ShadowMap(const Settings &settings) : settings(clamped(settings))
+    {
+        glGenFramebuffers(1, &FBO);
+        createTexture();
+    }
+
+    ~ShadowMap()
+    {
+        glDeleteTextures(1, &ID);
+        glDeleteFramebuffers(1, &FBO);
+    }
+
+    ShadowMap(const ShadowMap &) = delete;
+    ShadowMap &operator=(const ShadowMap &) = delete;
+
+    const Settings &GetSettings() const
+    {
+        return settings;
+    }
+
+    // the texture is only recreated when the resolution or the number of cascades changed
+    void SetSettings(Settings changed)
+    {
+        changed = clamped(changed);
+        bool recreate = changed.resolution != settings.resolution || changed.cascadeCount != settings.cascadeCount;
+        settings = changed;
+        if (recreate) {
+            glDeleteTextures(1, &ID);
+            createTexture();
+        }
+    }
+
+    unsigned int CascadeCount() const
+    {
+        return settings.cascadeCount;
+    }
+
+    // fits the cascades to the camera. view is the camera's view matrix, the rest its perspective projection.
+    void Update(const glm::mat4 &view, float fovy, float aspect, float nearPlane, float farPlane, const glm::vec3 &lightDirection)
+    {
+        PROFILE_SCOPE("Shadow cascades");
+        glm::mat4 cameraToWorld = glm::inverse(view);
+        glm::vec3 direction = glm::normalize(lightDirection);
+        glm::vec3 up = std::fabs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        float shadowDistance = std::min(farPlane, settings.maxDistance);
+        float tanY = std::tan(fovy * 0.5f), tanX = tanY * aspect;
+
+        float sliceNear = nearPlane;
+        for (unsigned int i = 0; i < settings.cascadeCount; i++) {
+            // practical split scheme: a blend of logarithmic and uniform splits
+            float t = (float) (i + 1) / settings.cascadeCount;
+            float logarithmic = nearPlane * std::pow(shadowDistance / nearPlane, t);
+            float uniform = nearPlane + (shadowDistance - nearPlane) * t;
+            float sliceFar = settings.splitLambda * logarithmic + (1.0f - settings.splitLambda) * uniform;
+            splits[i] = sliceFar;
+
+            // bounding sphere of the slice's corners
+            glm::vec3 corners[8];
+            int corner = 0;
+            for (float distance : {sliceNear, sliceFar})
+                for (float x : {-1.0f, 1.0f})
+                    for (float y : {-1.0f, 1.0f})
+                        corners[corner++] = glm::vec3(cameraToWorld * glm::vec4(x * tanX * distance, y * tanY * distance, -distance, 1.0f));
+            glm::vec3 center(0.0f);
+            for (const glm::vec3 &c : corners)
+                center += c;
+            center *= 1.0f / 8.0f;
+            float radius = 0.0f;
+            for (const glm::vec3 &c : corners)
+                radius = std::max(radius, glm::length(c - center));
+            // the radius only changes with the field of view, rounding keeps float noise from resizing the texels
+            radius = std::ceil(radius * 16.0f) / 16.0f;
+
+            float depthRange = 2.0f * radius + settings.casterDistance;
+            views[i] = glm::lookAt(center - direction * (radius + settings.casterDistance), center, up);
+            projections[i] = glm::ortho(-radius, radius, -radius, radius, 0.0f, depthRange);
+            depthRanges[i] = depthRange;
+
+            // move the projection so the world origin lands on a texel corner, the rest of the grid follows
+            glm::vec4 origin = projections[i] * views[i] * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+            float texels = settings.resolution * 0.5f;
+            projections[i][3][0] += (std::round(origin.x * texels) - origin.x * texels) / texels;
+            projections[i][3][1] += (std::round(origin.y * texels) - origin.y * texels) / texels;
+            sliceNear = sliceFar;
+        }
+    }
+
+    const glm::mat4 &View(unsigned int cascade) const
+    {
+        return views[cascade];
+    }
+
+    const glm::mat4 &Projection(unsigned int cascade) const
+    {
+        return projections[cascade];
+    }
+
+    glm::mat4 ViewProjection(unsigned int cascade) const
+    {
+        return projections[cascade] * views[cascade];
+    }
+
+    // distance from the light's eye to the far plane of the cascade, e.g. for RenderQueue::Begin
+    float DepthRange(unsigned int cascade) const
+    {
+        return depthRanges[cascade];
+    }
+
+    // the uniform block contents for the last Update
+    ShadowData Data(bool enabled = true) const
+    {
+        ShadowData data;
+        for (unsigned int i = 0; i < MAX_CASCADES; i++) {
+            data.lightSpace[i] = i < settings.cascadeCount ? ViewProjection(i) : glm::mat4(1.0f);
+            data.cascadeSplits[i] = i < settings.cascadeCount ? splits[i] : 0.0f;
+        }
+        data.cascadeCount = settings.cascadeCount;
+        data.texelSize = 1.0f / settings.resolution;
+        data.enabled = enabled ? 1 : 0;
+        data.padding = 0.0f;
+        return data;
+    }
+
+    // renders into the cascade's layer from now on, cleared. the viewport is the shadow map's.
+    void BeginCascade(unsigned int cascade)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, ID, 0, cascade);
+        glViewport(0, 0, settings.resolution, settings.resolution);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        // slope scaled bias against shadow acne
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(settings.slopeBias, settings.constantBias);
+    }
+
+    // back to the default framebuffer, the caller restores its own framebuffer and viewport
+    void End()
+    {
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void Bind(unsigned int unit) const
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, ID);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // bytes of GPU memory taken by the depth texture
+    size_t MemoryUsage() const
+    {
+        return (size_t) settings.resolution * settings.resolution * settings.cascadeCount * 4;
+    }
+
+private:
+    Settings settings;
+    unsigned int FBO = 0;
+    glm::mat4 views[MAX_CASCADES];
+    glm::mat4 projections[MAX_CASCADES];
+    float splits[MAX_CASCADES] = {0.0f};
+    float depthRanges[MAX_CASCADES] = {0.0f};
+
+    // the cascade arrays hold at most MAX_CASCADES
+    static Settings clamped(Settings settings)
+    {
+        settings.cascadeCount = std::max(1u, std::min(settings.cascadeCount, (unsigned int) MAX_CASCADES));
+        return settings;
+    }
+
+    void createTexture()
+    {
+        glGenTextures(1, &ID);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, ID);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, settings.resolution, settings.resolution, settings.cascadeCount,
+                     0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        // linear filtering of a comparison gives a 2x2 PCF per lookup
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        // outside the map is lit
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        float border[] = {1.0f, 1.0f, 1.0f, 1.0f};
+        glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, ID, 0, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Shadow map framebuffer not complete!" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+};
+#endif
@@ -0,0 +1,211 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/ktx.h>
+#include <learnopengl/texture_loader.h>
+
+#include <climits>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// Process wide cache of textures, shared by all Models and the loose textures in main.
+//
+// A texture is looked up by its canonical path. On a miss the TextureLoader reads and hashes the file on a
+// worker, which checks the hash against every image requested so far before decoding. If the same contents
+// were requested before (the same image copied under another name), nothing is decoded or uploaded and the
+// name handed out by Acquire becomes an alias of the first texture, so it has to be bound through Resolve.
+// Textures live until ReleaseAll. Images baked by bake_assets are uploaded straight from their .ktx,
+// everything else is decoded by the TextureLoader.
+class TextureCache
+{
+public:
+    struct Stats {
+        unsigned int hits = 0;
+        unsigned int misses = 0;
+        unsigned int textures = 0;
+        size_t bytesResident = 0;
+    };
+
+    static TextureCache &Get()
+    {
+        static TextureCache cache;
+        return cache;
+    }
+
+    // clampAlpha: see TextureLoader::Load2D, textures loaded with different settings are kept apart
+    unsigned int Acquire(const string &path, bool clampAlpha = false)
+    {
+        string pathKey = canonicalPath(path) + (clampAlpha ? "|clamp" : "");
+        unsigned int textureID;
+        if (lookup(pathKey, textureID))
+            return textureID;
+
+        if (Ktx::HasFreshBake(path)) {
+            size_t bytes = 0;
+            textureID = Ktx::Load2D(Ktx::PathFor(path), clampAlpha, bytes);
+            if (textureID) {
+                stats.misses++;
+                insert(textureID, {pathKey}, bytes);
+                return textureID;
+            }
+        }
+
+        stats.misses++;
+        shared_ptr<ContentTable> table = contents;
+        textureID = TextureLoader::Get().Load2D(path, clampAlpha, [table, clampAlpha](unsigned int loadedID, const string &contentHash) {
+            // the first texture with these contents decodes them, every later one shares it
+            lock_guard<mutex> lock(table->mutex);
+            auto owner = table->owners.emplace(contentHash + (clampAlpha ? "|clamp" : ""), loadedID);
+            return owner.second ? 0u : owner.first->second;
+        });
+        insert(textureID, {pathKey});
+        return textureID;
+    }
+
+    // cubemaps are only keyed by their (canonical) face paths
+    unsigned int AcquireCubemap(const vector<string> &faces)
+    {
+        string key = "cubemap";
+        for (const string &face : faces)
+            key += "|" + canonicalPath(face);
+        unsigned int textureID;
+        if (lookup(key, textureID))
+            return textureID;
+
+        bool baked = true;
+        vector<string> bakedFaces;
+        for (const string &face : faces) {
+            baked = baked && Ktx::HasFreshBake(face);
+            bakedFaces.push_back(Ktx::PathFor(face));
+        }
+        if (baked) {
+            size_t bytes = 0;
+            textureID = Ktx::LoadCubemap(bakedFaces, bytes);
+            if (textureID) {
+                stats.misses++;
+                insert(textureID, {key}, bytes);
+                return textureID;
+            }
+        }
+
+        stats.misses++;
+        textureID = TextureLoader::Get().LoadCubemap(faces);
+        insert(textureID, {key});
+        return textureID;
+    }
+
+    // the texture to bind for a name returned by Acquire
+    unsigned int Resolve(unsigned int textureID) const
+    {
+        if (aliases.empty())
+            return textureID;
+        auto alias = aliases.find(textureID);
+        return alias == aliases.end() ? textureID : alias->second;
+    }
+
+    // deletes every texture, call before the GL context goes away
+    void ReleaseAll()
+    {
+        for (auto &entry : entries)
+            glDeleteTextures(1, &entry.first);
+        entries.clear();
+        byKey.clear();
+        aliases.clear();
+        {
+            lock_guard<mutex> lock(contents->mutex);
+            contents->owners.clear();
+        }
+        stats.textures = 0;
+        stats.bytesResident = 0;
+    }
+
+    const Stats &GetStats() const
+    {
+        return stats;
+    }
+
+private:
+    struct Entry {
+        size_t bytes = 0;
+        vector<string> keys; // every key in byKey that points to this texture
+    };
+
+    // content hash (and load settings) -> texture that decodes it, filled in by the workers
+    struct ContentTable {
+        std::mutex mutex;
+        unordered_map<string, unsigned int> owners;
+    };
+
+    unordered_map<string, unsigned int> byKey;
+    unordered_map<unsigned int, Entry> entries;
+    // names handed out for duplicate images -> the texture that holds the contents
+    unordered_map<unsigned int, unsigned int> aliases;
+    shared_ptr<ContentTable> contents = make_shared<ContentTable>();
+    Stats stats;
+
+    TextureCache()
+    {
+        TextureLoader::Get().SetUploadListener([this](unsigned int textureID, size_t bytes) {
+            auto it = entries.find(textureID);
+            if (it == entries.end())
+                return;
+            it->second.bytes += bytes;
+            stats.bytesResident += bytes;
+        });
+        TextureLoader::Get().SetDuplicateListener([this](unsigned int textureID, unsigned int duplicateOf) {
+            auto duplicate = entries.find(textureID);
+            if (duplicate == entries.end())
+                return; // ReleaseAll ran in the meantime
+            aliases[textureID] = duplicateOf;
+            // later Acquires of this path get the shared texture directly, and it counts as a hit
+            Entry &owner = entries[duplicateOf];
+            for (const string &key : duplicate->second.keys) {
+                byKey[key] = duplicateOf;
+                owner.keys.push_back(key);
+            }
+            duplicate->second.keys.clear();
+            stats.misses--;
+            stats.hits++;
+            stats.textures--;
+        });
+    }
+
+    bool lookup(const string &key, unsigned int &textureID)
+    {
+        auto it = byKey.find(key);
+        if (it == byKey.end())
+            return false;
+        textureID = it->second;
+        stats.hits++;
+        return true;
+    }
+
+    // bytes: size of the data if it is already uploaded, otherwise the upload listener fills it in
+    void insert(unsigned int textureID, vector<string> keys, size_t bytes = 0)
+    {
+        Entry &entry = entries[textureID];
+        entry.bytes = bytes;
+        stats.bytesResident += bytes;
+        for (const string &key : keys) {
+            byKey[key] = textureID;
+            entry.keys.push_back(key);
+        }
+        stats.textures++;
+    }
+
+    static string canonicalPath(const string &path)
+    {
+        char resolved[PATH_MAX];
+        if (realpath(path.c_str(), resolved))
+            return resolved;
+        return path;
+    }
+};
+#endif
@@ -0,0 +1,275 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <learnopengl/cpu_profiler.h>
+#include <learnopengl/thread_pool.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Decodes images on the worker pool and uploads them on the GL thread.
+//
+// Load2D/LoadCubemap return a texture name right away, with a 1x1 transparent black placeholder in it.
+// The image is decoded into staging memory by a worker and ProcessUploads, called once per frame on the
+// GL thread, replaces the placeholder with the real data. Since the texture name never changes, meshes
+// and shaders can hold on to it from the start.
+class TextureLoader
+{
+public:
+    // how much decoded data ProcessUploads pushes to the GPU per call by default (at least one image is always uploaded)
+    static const size_t DEFAULT_UPLOAD_BUDGET = 16 * 1024 * 1024;
+
+    static TextureLoader &Get()
+    {
+        static TextureLoader loader;
+        return loader;
+    }
+
+    // called on a worker once the file is read, with the texture name and a hash of the file contents. returns a
+    // texture that already has (or is going to get) the same contents, or 0 if this one has to be decoded.
+    typedef function<unsigned int(unsigned int textureID, const string &contentHash)> DuplicateCheck;
+
+    // repeat is used as wrap mode, unless clampAlpha is set and the image turns out to have an alpha channel.
+    // with isDuplicate the worker reads and hashes the file first, a duplicate is neither decoded nor uploaded.
+    unsigned int Load2D(const string &path, bool clampAlpha = false, DuplicateCheck isDuplicate = nullptr)
+    {
+        unsigned int textureID = createPlaceholder(GL_TEXTURE_2D);
+        queueDecode(path, textureID, GL_TEXTURE_2D, clampAlpha, nullptr, isDuplicate);
+        return textureID;
+    }
+
+    // faces in the order +X, -X, +Y, -Y, +Z, -Z
+    unsigned int LoadCubemap(const vector<string> &faces)
+    {
+        unsigned int textureID = createPlaceholder(GL_TEXTURE_CUBE_MAP);
+        shared_ptr<unsigned int> facesLeft = make_shared<unsigned int>(faces.size());
+        for (unsigned int i = 0; i < faces.size(); i++)
+            queueDecode(faces[i], textureID, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, false, facesLeft, nullptr);
+        return textureID;
+    }
+
+    // uploads decoded images until the byte budget is used up. returns the number of images uploaded.
+    unsigned int ProcessUploads(size_t byteBudget = DEFAULT_UPLOAD_BUDGET)
+    {
+        PROFILE_SCOPE("Texture uploads");
+        vector<Decoded> batch;
+        {
+            lock_guard<mutex> lock(shared->mutex);
+            size_t bytes = 0;
+            size_t taken = 0;
+            while (taken < shared->decoded.size() && (taken == 0 || bytes < byteBudget)) {
+                Decoded &image = shared->decoded[taken++];
+                bytes += (size_t) image.width * image.height * image.components;
+            }
+            batch.assign(shared->decoded.begin(), shared->decoded.begin() + taken);
+            shared->decoded.erase(shared->decoded.begin(), shared->decoded.begin() + taken);
+        }
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (Decoded &image : batch) {
+            upload(image);
+            stbi_image_free(image.data);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        pending -= batch.size();
+        return batch.size();
+    }
+
+    // called after every successful upload with the texture name and the number of bytes uploaded for it
+    void SetUploadListener(function<void(unsigned int, size_t)> listener)
+    {
+        uploadListener = listener;
+    }
+
+    // called on the GL thread for every texture whose image turned out to be a duplicate, with the texture it duplicates
+    void SetDuplicateListener(function<void(unsigned int, unsigned int)> listener)
+    {
+        duplicateListener = listener;
+    }
+
+    // number of images that were requested but are not on the GPU yet
+    unsigned int Pending() const
+    {
+        return pending;
+    }
+
+    // blocks until every requested image is uploaded
+    void Finish()
+    {
+        while (pending > 0) {
+            if (ProcessUploads(~(size_t) 0) == 0)
+                this_thread::yield();
+        }
+    }
+
+private:
+    struct Decoded {
+        string path;
+        unsigned int textureID;
+        GLenum target;
+        bool clampAlpha;
+        shared_ptr<unsigned int> facesLeft; // only set for cubemap faces
+        unsigned int duplicateOf; // set instead of data if another texture has the same contents
+        unsigned char *data;
+        int width, height, components;
+    };
+
+    // state shared with the decode jobs, kept alive by them even if the loader itself is gone
+    struct Shared {
+        std::mutex mutex;
+        vector<Decoded> decoded;
+
+        ~Shared()
+        {
+            for (Decoded &image : decoded)
+                stbi_image_free(image.data);
+        }
+    };
+
+    shared_ptr<Shared> shared = make_shared<Shared>();
+    unsigned int pending = 0;
+    function<void(unsigned int, size_t)> uploadListener;
+    function<void(unsigned int, unsigned int)> duplicateListener;
+
+    TextureLoader() = default;
+
+    unsigned int createPlaceholder(GLenum type)
+    {
+        static const unsigned char placeholder[4] = {0, 0, 0, 0};
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(type, textureID);
+        if (type == GL_TEXTURE_CUBE_MAP) {
+            for (unsigned int i = 0; i < 6; i++)
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+        } else {
+            glTexImage2D(type, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+        }
+        glTexParameteri(type, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(type, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(type, 0);
+        return textureID;
+    }
+
+    void queueDecode(const string &path, unsigned int textureID, GLenum target, bool clampAlpha, shared_ptr<unsigned int> facesLeft, DuplicateCheck isDuplicate)
+    {
+        pending++;
+        shared_ptr<Shared> state = shared;
+        WorkerPool().enqueue([state, path, textureID, target, clampAlpha, facesLeft, isDuplicate] {
+            PROFILE_SCOPE("Texture decode");
+            Decoded image{path, textureID, target, clampAlpha, facesLeft, 0, nullptr, 0, 0, 0};
+            if (isDuplicate) {
+                vector<unsigned char> contents;
+                if (readFile(path, contents)) {
+                    image.duplicateOf = isDuplicate(textureID, contentHash(contents));
+                    if (!image.duplicateOf)
+                        image.data = stbi_load_from_memory(contents.data(), contents.size(), &image.width, &image.height, &image.components, 0);
+                }
+            } else {
+                image.data = stbi_load(path.c_str(), &image.width, &image.height, &image.components, 0);
+            }
+            lock_guard<mutex> lock(state->mutex);
+            state->decoded.push_back(image);
+        });
+    }
+
+    static bool readFile(const string &path, vector<unsigned char> &contents)
+    {
+        ifstream in(path, ios::binary);
+        if (!in)
+            return false;
+        in.seekg(0, ios::end);
+        contents.resize((size_t) in.tellg());
+        in.seekg(0, ios::beg);
+        in.read((char *) contents.data(), contents.size());
+        return in && !contents.empty();
+    }
+
+    // 64 bit FNV style hash, consuming 8 bytes per step so hashing a few MB stays in the low milliseconds
+    static string contentHash(const vector<unsigned char> &contents)
+    {
+        uint64_t hash = 0xcbf29ce484222325ull ^ contents.size();
+        size_t i = 0;
+        for (; i + 8 <= contents.size(); i += 8) {
+            uint64_t word;
+            memcpy(&word, &contents[i], 8);
+            hash = (hash ^ word) * 0x100000001b3ull;
+            hash ^= hash >> 29;
+        }
+        for (; i < contents.size(); i++)
+            hash = (hash ^ contents[i]) * 0x100000001b3ull;
+
+        char key[48];
+        snprintf(key, sizeof(key), "#%016llx:%zu", (unsigned long long) hash, contents.size());
+        return key;
+    }
+
+    static GLenum formatFor(int components)
+    {
+        if (components == 1)
+            return GL_RED;
+        else if (components == 2)
+            return GL_RG;
+        else if (components == 3)
+            return GL_RGB;
+        return GL_RGBA;
+    }
+
+    void upload(const Decoded &image)
+    {
+        bool cubemapFace = image.target != GL_TEXTURE_2D;
+        GLenum type = cubemapFace ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+        if (image.duplicateOf) {
+            if (duplicateListener)
+                duplicateListener(image.textureID, image.duplicateOf);
+            return;
+        }
+        if (!image.data) {
+            if (cubemapFace)
+                std::cout << "Cubemap texture failed to load at path: " << image.path << std::endl;
+            else
+                std::cout << "Texture failed to load at path: " << image.path << std::endl;
+        } else {
+            GLenum format = formatFor(image.components);
+            glBindTexture(type, image.textureID);
+            glTexImage2D(image.target, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data);
+            if (uploadListener) {
+                size_t bytes = (size_t) image.width * image.height * image.components;
+                // a full mip chain adds another third
+                uploadListener(image.textureID, cubemapFace ? bytes : bytes + bytes / 3);
+            }
+        }
+
+        if (!cubemapFace) {
+            if (!image.data)
+                return; // keep the placeholder
+            GLenum wrap = image.clampAlpha && image.components == 4 ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+            glGenerateMipmap(GL_TEXTURE_2D);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        } else if (--*image.facesLeft == 0) {
+            glBindTexture(GL_TEXTURE_CUBE_MAP, image.textureID);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(type, 0);
+    }
+};
+#endif
@@ -0,0 +1,99 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <learnopengl/cpu_profiler.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Fixed size pool of worker threads executing jobs in FIFO order.
+// Jobs must not touch OpenGL, there is no context current on the workers.
+class ThreadPool
+{
+public:
+    // by default one thread is left for the render (GL) thread. hardware_concurrency may report 0, which counts as 2 here
+    explicit ThreadPool(unsigned int threadCount = std::max(2u, std::thread::hardware_concurrency()) - 1)
+    {
+        threadCount = std::max(1u, threadCount);
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back([this, i] {
+                PROFILE_THREAD_NAME("worker " + std::to_string(i));
+                workerLoop();
+            });
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // finishes all queued jobs before returning
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+
+    // queues a job and returns a future for its result
+    template<typename F>
+    auto enqueue(F &&job) -> std::future<decltype(job())>
+    {
+        typedef decltype(job()) Result;
+        // packaged_task is move only, std::function needs something copyable
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(job));
+        std::future<Result> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push([task] { (*task)(); });
+        }
+        wakeUp.notify_one();
+        return result;
+    }
+
+    unsigned int size() const
+    {
+        return workers.size();
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool stopping = false;
+
+    void workerLoop()
+    {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeUp.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (jobs.empty())
+                    return; // stopping and nothing left to do
+                job = std::move(jobs.front());
+                jobs.pop();
+            }
+            job();
+        }
+    }
+};
+
+// the pool shared by all loaders (models, textures, ...)
+inline ThreadPool &WorkerPool()
+{
+    static ThreadPool pool;
+    return pool;
+}
+#endif
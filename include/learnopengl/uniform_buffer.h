@@ -0,0 +1,44 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/cpu_profiler.h>
+
+// binding points of the uniform blocks shared by all programs, see Shader::bindUniformBlock
+enum UniformBlockBinding : GLuint {
+    FRAME_DATA_BINDING = 0,
+    LIGHT_DATA_BINDING = 1,
+    SHADOW_DATA_BINDING = 2,
+    CLUSTER_DATA_BINDING = 3,
+};
+
+// A uniform buffer holding one T, bound to a fixed binding point.
+// T has to match the std140 layout of the block in the shaders (vec3 members padded to 16 bytes, ...).
+template<typename T>
+class UniformBuffer
+{
+public:
+    unsigned int ID;
+
+    explicit UniformBuffer(GLuint binding)
+    {
+        glGenBuffers(1, &ID);
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+    }
+
+    // replaces the contents, once per frame. the old storage is orphaned so the driver doesn't have to wait
+    // for draws of the previous frame that still read it.
+    void Update(const T &data)
+    {
+        PROFILE_SCOPE("Uniform upload");
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+};
+#endif
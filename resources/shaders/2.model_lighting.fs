@@ -2,6 +2,7 @@
 
 layout (location = 0) out vec4 FragColor;
 layout (location = 1) out vec4 BrightColor;
+layout (location = 2) out float Overdraw; // added up per pixel for the overdraw view
 
 struct DirLight {
     vec3 direction;
@@ -21,15 +22,55 @@ in vec2 TexCoords;
 in vec3 Normal;
 in vec3 FragPos;
 
-uniform DirLight dirLight;
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+    float bloomThreshold; // brightness above which a pixel goes to BrightColor
+};
+
+layout (std140) uniform LightData {
+    DirLight dirLight;
+};
+
+// the sun's cascaded shadow maps, see ShadowMap
+layout (std140) uniform ShadowData {
+    mat4 lightSpace[4];
+    vec4 cascadeSplits; // view space distance where each cascade ends
+    int cascadeCount;
+    float texelSize;
+    int shadowsEnabled;
+};
+uniform sampler2DArrayShadow shadowMap;
+
 uniform Material material;
 uniform bool Blinn;
 
-uniform vec3 viewPosition;
-
 // calculates the color when using a point light.
 
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
+// how much of the sun reaches fragPos, 0 in full shadow
+float CalcShadow(vec3 fragPos)
+{
+    if (shadowsEnabled == 0)
+        return 1.0;
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    int cascade = 0;
+    while (cascade < cascadeCount && depth > cascadeSplits[cascade])
+        cascade++;
+    if (cascade == cascadeCount)
+        return 1.0; // further than the shadows reach
+    vec3 coords = (lightSpace[cascade] * vec4(fragPos, 1.0)).xyz * 0.5 + 0.5;
+    if (coords.z > 1.0)
+        return 1.0;
+    // 3x3 PCF, every lookup is already a filtered 2x2 comparison
+    float lit = 0.0;
+    for (int x = -1; x <= 1; x++)
+        for (int y = -1; y <= 1; y++)
+            lit += texture(shadowMap, vec4(coords.xy + vec2(x, y) * texelSize, cascade, coords.z));
+    return lit / 9.0;
+}
+
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, float shadow)
 {
     vec3 lightDir = normalize(-light.direction);
     // diffuse shading
@@ -49,17 +90,18 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
     vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
     vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
-    return (ambient + diffuse + specular);
+    return (ambient + shadow * (diffuse + specular));
 }
 
 void main()
 {
     vec3 normal = normalize(Normal);
     vec3 viewDir = normalize(viewPosition - FragPos);
-    vec3 result = CalcDirLight(dirLight, normal, viewDir);
+    vec3 result = CalcDirLight(dirLight, normal, viewDir, CalcShadow(FragPos));
     FragColor = vec4(result, 1.0);
+    Overdraw = 1.0;
     float brightness = dot(result, vec3(0.2126, 0.7152, 0.0722));
-    if(brightness > 1.0)
+    if(brightness > bloomThreshold)
         BrightColor = vec4(result, 1.0);
     else
         BrightColor = vec4(0.0, 0.0, 0.0, 1.0);
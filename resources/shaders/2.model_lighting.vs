@@ -6,14 +6,25 @@ layout (location = 2) in vec2 aTexCoords;
 out vec2 TexCoords;
 out vec3 Normal;
 out vec3 FragPos;
+// the depth prepass draws with this same shader, its depth has to match exactly for GL_EQUAL
+invariant gl_Position;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// packed meshes store positions as 0..1 within their bounds (Mesh::BindVertexFormat), float ones get 0 and 1
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+    float bloomThreshold;
+};
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
+    vec3 position = positionOffset + aPos * positionScale;
+    FragPos = vec3(model * vec4(position, 1.0));
     Normal = aNormal;
     TexCoords = aTexCoords;    
     gl_Position = projection * view * vec4(FragPos, 1.0);
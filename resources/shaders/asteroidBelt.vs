@@ -0,0 +1,50 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+// per instance, see AsteroidInstance
+layout (location = 5) in vec4 aPositionScale; // xyz: position in the belt, w: radius
+layout (location = 6) in vec4 aRotation;      // xyz: axis * angular speed, w: angle at time 0
+
+out vec2 TexCoords;
+out vec3 Normal;
+out vec3 FragPos;
+// the depth prepass draws with this same shader, its depth has to match exactly for GL_EQUAL
+invariant gl_Position;
+
+uniform mat4 model;     // placement of the whole belt
+uniform vec4 prototype; // xyz: center of the rock mesh, w: 1 / its radius
+uniform float time;
+// packed meshes store positions as 0..1 within their bounds (Mesh::BindVertexFormat), float ones get 0 and 1
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+    float bloomThreshold;
+};
+
+// rotates v around a unit axis (Rodrigues' formula)
+vec3 rotate(vec3 v, vec3 axis, float angle)
+{
+    float c = cos(angle);
+    float s = sin(angle);
+    return v * c + cross(axis, v) * s + axis * dot(axis, v) * (1.0 - c);
+}
+
+void main()
+{
+    float speed = length(aRotation.xyz);
+    vec3 axis = speed > 0.0 ? aRotation.xyz / speed : vec3(0.0, 1.0, 0.0);
+    float angle = aRotation.w + speed * time;
+
+    vec3 position = positionOffset + aPos * positionScale;
+    vec3 local = (position - prototype.xyz) * (prototype.w * aPositionScale.w);
+    FragPos = vec3(model * vec4(rotate(local, axis, angle) + aPositionScale.xyz, 1.0));
+    // the rock meshes come with inward facing normals
+    Normal = -(mat3(model) * rotate(aNormal, axis, angle));
+    TexCoords = aTexCoords;
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
@@ -0,0 +1,61 @@
+#version 330 core
+// one step down the bloom mip chain: 13 taps around the texel, weighted as five overlapping 2x2 boxes
+// (Jimenez, "Next Generation Post Processing in Call of Duty: Advanced Warfare")
+out vec3 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D source;
+// on the first step, every box is weighted by 1 / (1 + luma) so single very bright pixels don't flicker
+uniform bool karisAverage;
+// the part of source to read, less than 1 when the scene was drawn at a lower resolution (see RenderTargets)
+uniform vec2 uvScale;
+
+float karisWeight(vec3 color)
+{
+    return 1.0 / (1.0 + dot(color, vec3(0.2126, 0.7152, 0.0722)));
+}
+
+vec3 tap(vec2 uv, vec2 uvMax)
+{
+    return texture(source, min(uv, uvMax)).rgb;
+}
+
+void main()
+{
+    vec2 texel = 1.0 / vec2(textureSize(source, 0));
+    float x = texel.x, y = texel.y;
+    vec2 uv = TexCoords * uvScale;
+    vec2 uvMax = uvScale - 0.5 * texel;
+
+    // a - b - c
+    // - j - k -
+    // d - e - f
+    // - l - m -
+    // g - h - i
+    vec3 a = tap(uv + vec2(-2.0 * x, 2.0 * y), uvMax);
+    vec3 b = tap(uv + vec2(0.0, 2.0 * y), uvMax);
+    vec3 c = tap(uv + vec2(2.0 * x, 2.0 * y), uvMax);
+    vec3 d = tap(uv + vec2(-2.0 * x, 0.0), uvMax);
+    vec3 e = tap(uv, uvMax);
+    vec3 f = tap(uv + vec2(2.0 * x, 0.0), uvMax);
+    vec3 g = tap(uv + vec2(-2.0 * x, -2.0 * y), uvMax);
+    vec3 h = tap(uv + vec2(0.0, -2.0 * y), uvMax);
+    vec3 i = tap(uv + vec2(2.0 * x, -2.0 * y), uvMax);
+    vec3 j = tap(uv + vec2(-x, y), uvMax);
+    vec3 k = tap(uv + vec2(x, y), uvMax);
+    vec3 l = tap(uv + vec2(-x, -y), uvMax);
+    vec3 m = tap(uv + vec2(x, -y), uvMax);
+
+    vec3 boxes[5] = vec3[]((j + k + l + m) * 0.25, (a + b + d + e) * 0.25, (b + c + e + f) * 0.25,
+                           (d + e + g + h) * 0.25, (e + f + h + i) * 0.25);
+    float weights[5] = float[](0.5, 0.125, 0.125, 0.125, 0.125);
+    vec3 result = vec3(0.0);
+    float total = 0.0;
+    for (int box = 0; box < 5; box++) {
+        float weight = weights[box] * (karisAverage ? karisWeight(boxes[box]) : 1.0);
+        result += boxes[box] * weight;
+        total += weight;
+    }
+    FragColor = max(result / total, 0.0001);
+}
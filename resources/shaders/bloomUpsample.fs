@@ -0,0 +1,21 @@
+#version 330 core
+// one step up the bloom mip chain: a 3x3 tent filter of the smaller level, added onto the larger one
+out vec3 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D source;
+uniform float filterRadius; // in texels of the smaller level
+
+void main()
+{
+    vec2 offset = filterRadius / vec2(textureSize(source, 0));
+    float x = offset.x, y = offset.y;
+
+    vec3 result = texture(source, TexCoords).rgb * 4.0;
+    result += (texture(source, TexCoords + vec2(-x, 0.0)).rgb + texture(source, TexCoords + vec2(x, 0.0)).rgb +
+               texture(source, TexCoords + vec2(0.0, -y)).rgb + texture(source, TexCoords + vec2(0.0, y)).rgb) * 2.0;
+    result += texture(source, TexCoords + vec2(-x, -y)).rgb + texture(source, TexCoords + vec2(x, -y)).rgb +
+              texture(source, TexCoords + vec2(-x, y)).rgb + texture(source, TexCoords + vec2(x, y)).rgb;
+    FragColor = result / 16.0;
+}
@@ -0,0 +1,170 @@
+#version 330 core
+// deferred shading: lights the G-buffer written by gBuffer.fs, one full screen triangle (fullScreen.vs).
+// the lighting is the same as newShader.fs, the surface comes from the G-buffer instead of the material.
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec4 BrightColor;
+
+in vec2 TexCoords;
+
+struct DirLight {
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+    float bloomThreshold; // brightness above which a pixel goes to BrightColor
+};
+
+layout (std140) uniform LightData {
+    DirLight dirLight;
+};
+
+// the sun's cascaded shadow maps, see ShadowMap
+layout (std140) uniform ShadowData {
+    mat4 lightSpace[4];
+    vec4 cascadeSplits; // view space distance where each cascade ends
+    int cascadeCount;
+    float texelSize;
+    int shadowsEnabled;
+};
+uniform sampler2DArrayShadow shadowMap;
+
+// point and spot lights, binned into clusters of the view frustum, see ClusteredLights
+layout (std140) uniform ClusterData {
+    vec4 clusterGrid;  // clusters along x, y and z
+    vec4 clusterScale; // xy: clusters per pixel, zw: slice = log(depth) * z + w
+};
+uniform samplerBuffer lights;         // four texels per light
+uniform usamplerBuffer clusters;      // per cluster: first index and count in lightIndices
+uniform usamplerBuffer lightIndices;
+
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormalLight;
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;
+uniform vec2 uvScale; // the part of the G-buffer the scene was drawn to, see RenderTargets
+uniform float shininess;
+uniform bool Blinn;
+
+// how much of the sun reaches fragPos, 0 in full shadow
+float CalcShadow(vec3 fragPos)
+{
+    if (shadowsEnabled == 0)
+        return 1.0;
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    int cascade = 0;
+    while (cascade < cascadeCount && depth > cascadeSplits[cascade])
+        cascade++;
+    if (cascade == cascadeCount)
+        return 1.0; // further than the shadows reach
+    vec3 coords = (lightSpace[cascade] * vec4(fragPos, 1.0)).xyz * 0.5 + 0.5;
+    if (coords.z > 1.0)
+        return 1.0;
+    // 3x3 PCF, every lookup is already a filtered 2x2 comparison
+    float lit = 0.0;
+    for (int x = -1; x <= 1; x++)
+        for (int y = -1; y <= 1; y++)
+            lit += texture(shadowMap, vec4(coords.xy + vec2(x, y) * texelSize, cascade, coords.z));
+    return lit / 9.0;
+}
+
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, float shadow, vec3 albedo, float specularMap, float dirLightScale)
+{
+    vec3 lightDir = normalize(-light.direction);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    float spec = 0.0;
+    if (Blinn) {
+        vec3 halfwayDir = normalize(lightDir + viewDir);
+        spec = pow(max(dot(normal, halfwayDir), 0.0), 4 * shininess);
+    } else {
+        vec3 reflectDir = reflect(-lightDir, normal);
+        spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    }
+    // combine results
+    vec3 ambient = light.ambient * albedo;
+    vec3 diffuse = light.diffuse * dirLightScale * diff * albedo;
+    vec3 specular = light.specular * spec * specularMap;
+    return (ambient + shadow * (diffuse + specular));
+}
+
+// one light of the clustered lighting, diffuseColor and specularColor are the material's at this fragment
+vec3 CalcClusteredLight(int light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 diffuseColor, vec3 specularColor)
+{
+    vec4 positionRadius = texelFetch(lights, light * 4);
+    vec4 directionCutOff = texelFetch(lights, light * 4 + 1);
+    vec4 diffuseOuterCutOff = texelFetch(lights, light * 4 + 2);
+    vec4 attenuationSpecular = texelFetch(lights, light * 4 + 3); // x: linear, y: quadratic, z: specular
+
+    vec3 toLight = positionRadius.xyz - fragPos;
+    float distance = length(toLight);
+    if (distance >= positionRadius.w)
+        return vec3(0.0);
+    vec3 lightDir = toLight / distance;
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    float spec = 0.0;
+    if (Blinn) {
+        vec3 halfwayDir = normalize(lightDir + viewDir);
+        spec = pow(max(dot(normal, halfwayDir), 0.0), 4 * shininess);
+    } else {
+        vec3 reflectDir = reflect(-lightDir, normal);
+        spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    }
+    // attenuation, faded out towards the radius where the clusters stop listing the light
+    float attenuation = 1.0 / (1.0 + attenuationSpecular.x * distance + attenuationSpecular.y * (distance * distance));
+    float fade = clamp(1.0 - pow(distance / positionRadius.w, 4.0), 0.0, 1.0);
+    attenuation *= fade * fade;
+    // spotlight intensity, point lights have a cone that includes everything
+    float theta = dot(lightDir, normalize(-directionCutOff.xyz));
+    float epsilon = directionCutOff.w - diffuseOuterCutOff.w;
+    float intensity = clamp((theta - diffuseOuterCutOff.w) / epsilon, 0.0, 1.0);
+
+    vec3 diffuse = diffuseOuterCutOff.rgb * diff * diffuseColor;
+    vec3 specular = vec3(attenuationSpecular.z) * spec * specularColor;
+    return (diffuse + specular) * attenuation * intensity;
+}
+
+void main()
+{
+    // the G-buffer is only drawn to up to uvScale, TexCoords are the viewport's
+    vec2 uv = TexCoords * uvScale;
+    float depth = texture(gDepth, uv).r;
+    if (depth == 1.0)
+        discard; // nothing drawn here, the skybox fills it in
+    // world position from the depth
+    vec4 clip = vec4(vec3(TexCoords, depth) * 2.0 - 1.0, 1.0);
+    vec4 world = inverseViewProjection * clip;
+    vec3 fragPos = world.xyz / world.w;
+
+    vec4 albedoSpecular = texture(gAlbedoSpecular, uv);
+    vec4 normalLight = texture(gNormalLight, uv);
+    vec3 normal = normalize(normalLight.xyz);
+    vec3 viewDir = normalize(viewPosition - fragPos);
+    vec3 result = CalcDirLight(dirLight, normal, viewDir, CalcShadow(fragPos), albedoSpecular.rgb, albedoSpecular.a, normalLight.w);
+
+    // the clustered lights as in newShader.fs
+    float viewDepth = -(view * vec4(fragPos, 1.0)).z;
+    vec3 cell = vec3(gl_FragCoord.xy * clusterScale.xy, floor(log(viewDepth) * clusterScale.z + clusterScale.w));
+    ivec3 cluster = ivec3(clamp(cell, vec3(0.0), clusterGrid.xyz - 1.0));
+    ivec3 grid = ivec3(clusterGrid.xyz);
+    uvec2 range = texelFetch(clusters, (cluster.z * grid.y + cluster.y) * grid.x + cluster.x).xy;
+    for (uint i = 0u; i < range.y; i++)
+        result += CalcClusteredLight(int(texelFetch(lightIndices, int(range.x + i)).r), normal, fragPos, viewDir,
+                                     albedoSpecular.rgb, vec3(albedoSpecular.a));
+
+    FragColor = vec4(result, 1.0);
+    float brightness = dot(result, vec3(0.2126, 0.7152, 0.0722));
+    if(brightness > bloomThreshold)
+        BrightColor = vec4(result, 1.0);
+    else
+        BrightColor = vec4(0.0, 0.0, 0.0, 1.0);
+}
@@ -0,0 +1,5 @@
+#version 330 core
+// depth prepass: the lit vertex shaders are reused as they are, nothing is written but depth
+void main()
+{
+}
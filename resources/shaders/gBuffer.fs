@@ -0,0 +1,27 @@
+#version 330 core
+// deferred shading: the lit vertex shaders write the surface into the G-buffer, deferredLighting.fs lights it.
+// the outputs line up with hdrFBO's attachments, 0 and 1 are not drawn to in this pass.
+layout (location = 2) out float Overdraw;   // added up per pixel for the overdraw view
+layout (location = 3) out vec4 AlbedoSpecular; // rgb: diffuse texture, a: specular texture
+layout (location = 4) out vec4 NormalLight;    // xyz: normal, w: dirLightScale
+
+struct Material {
+    sampler2D texture_diffuse1;
+    sampler2D texture_specular1;
+
+    float shininess;
+};
+in vec2 TexCoords;
+in vec3 Normal;
+in vec3 FragPos;
+
+uniform Material material;
+// scales the diffuse term of the sun for this object
+uniform float dirLightScale;
+
+void main()
+{
+    AlbedoSpecular = vec4(texture(material.texture_diffuse1, TexCoords).rgb, texture(material.texture_specular1, TexCoords).r);
+    NormalLight = vec4(normalize(Normal), dirLightScale);
+    Overdraw = 1.0;
+}
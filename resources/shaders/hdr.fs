@@ -5,18 +5,36 @@ in vec2 TexCoords;
 
 uniform sampler2D hdrBuffer;
 uniform sampler2D bloomBlur;
+uniform sampler2D overdraw;
+uniform bool showOverdraw;
 uniform bool hdr;
 uniform bool bloom;
 uniform float exposure;
+uniform vec2 uvScale; // the part of hdrBuffer and overdraw the scene was drawn to, see RenderTargets
+uniform float bloomIntensity; // the bloom texture is the sum of all its levels
+
+// how often the lighting shaders ran per pixel: black none, blue once, then green, yellow and red for 4+
+vec3 heat(float count)
+{
+    const vec3 colors[5] = vec3[](vec3(0.0), vec3(0.0, 0.0, 1.0), vec3(0.0, 1.0, 0.0), vec3(1.0, 1.0, 0.0), vec3(1.0, 0.0, 0.0));
+    float index = clamp(count, 0.0, 4.0);
+    return mix(colors[int(floor(index))], colors[min(int(floor(index)) + 1, 4)], fract(index));
+}
 
 void main()
 {
+    if (showOverdraw) {
+        FragColor = vec4(heat(texture(overdraw, TexCoords * uvScale).r), 1.0);
+        return;
+    }
     const float gamma = 2.2;
-    vec3 hdrColor = texture(hdrBuffer, TexCoords).rgb;
+    // upsampled bilinearly when the scene was drawn at a lower resolution, kept off the texels outside it
+    vec2 uvMax = uvScale - 0.5 / vec2(textureSize(hdrBuffer, 0));
+    vec3 hdrColor = texture(hdrBuffer, min(TexCoords * uvScale, uvMax)).rgb;
     vec3 bloomColor = texture(bloomBlur, TexCoords).rgb;
 
     if (bloom) {
-        hdrColor += bloomColor;
+        hdrColor += bloomColor * bloomIntensity;
     }
     if(hdr)
     {
@@ -0,0 +1,19 @@
+#version 330 core
+// shows one level of the hierarchical Z buffer, near is black and the far plane white
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D hiZ;
+uniform int level;
+uniform float nearPlane;
+uniform float farPlane;
+
+void main()
+{
+    ivec2 size = textureSize(hiZ, level);
+    float depth = texelFetch(hiZ, min(ivec2(TexCoords * vec2(size)), size - 1), level).r;
+    float z = depth * 2.0 - 1.0;
+    float linearDepth = (2.0 * nearPlane * farPlane) / (farPlane + nearPlane - z * (farPlane - nearPlane));
+    FragColor = vec4(vec3(sqrt(linearDepth / farPlane)), 1.0);
+}
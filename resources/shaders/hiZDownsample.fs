@@ -0,0 +1,30 @@
+#version 330 core
+// one level of the hierarchical Z buffer: the farthest of the source texels below this one
+layout (location = 0) out float FarthestDepth;
+
+uniform sampler2D source; // the depth buffer or the previous level (its only visible level)
+uniform ivec2 sourceSize; // texels of source to reduce, less than its size if the scene only covered part of it
+
+float fetch(ivec2 coord, ivec2 size)
+{
+    return texelFetch(source, min(coord, size - 1), 0).r;
+}
+
+void main()
+{
+    ivec2 size = sourceSize;
+    ivec2 coord = ivec2(gl_FragCoord.xy) * 2;
+    float depth = max(max(fetch(coord, size), fetch(coord + ivec2(1, 0), size)),
+                      max(fetch(coord + ivec2(0, 1), size), fetch(coord + ivec2(1, 1), size)));
+
+    // with an odd size the last row/column of the source has no texel of its own here, fold it in
+    bool extraColumn = (size.x & 1) != 0 && coord.x == size.x - 3;
+    bool extraRow = (size.y & 1) != 0 && coord.y == size.y - 3;
+    if (extraColumn)
+        depth = max(depth, max(fetch(coord + ivec2(2, 0), size), fetch(coord + ivec2(2, 1), size)));
+    if (extraRow)
+        depth = max(depth, max(fetch(coord + ivec2(0, 2), size), fetch(coord + ivec2(1, 2), size)));
+    if (extraColumn && extraRow)
+        depth = max(depth, fetch(coord + ivec2(2, 2), size));
+    FarthestDepth = depth;
+}
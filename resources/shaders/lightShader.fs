@@ -6,13 +6,14 @@ in VS_OUT {
     vec3 FragPos;
     vec3 Normal;
     vec2 TexCoords;
+    vec4 Color;
 } fs_in;
 
 uniform sampler2D diffuseTexture;
 
 void main()
 {
-    vec4 color = texture(diffuseTexture, fs_in.TexCoords).rgba;
+    vec4 color = texture(diffuseTexture, fs_in.TexCoords).rgba * fs_in.Color;
     if(color.a < 0.1)
             discard;
 
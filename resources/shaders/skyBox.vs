@@ -4,8 +4,12 @@ layout (location = 0) in vec3 aPos;
 out vec3 TexCoords;
 out vec2 planetTexCoords;
 
-uniform mat4 projection;
-uniform mat4 view;
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+    float bloomThreshold;
+};
 
 void main()
 {
@@ -13,6 +17,7 @@ void main()
     planetTexCoords = vec2(TexCoords.x > 0.5 ? (TexCoords.x - 0.5) * 2.0 : 0.0,
                                 TexCoords.y > 0.5 ? (TexCoords.y - 0.5) * 2.0: 0.0);
 
-    vec4 pos = projection * view * vec4(aPos, 1.0);
+    // the skybox follows the camera, only the rotation of the view matrix is used
+    vec4 pos = projection * mat4(mat3(view)) * vec4(aPos, 1.0);
     gl_Position = pos.xyww;
 }
\ No newline at end of file
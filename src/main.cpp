@@ -12,9 +12,29 @@
 #include <learnopengl/filesystem.h>
 #include <learnopengl/shader.h>
 #include <learnopengl/camera.h>
+#include <learnopengl/camera_track.h>
 #include <learnopengl/model.h>
+#include <learnopengl/billboard_renderer.h>
+#include <learnopengl/asteroid_belt.h>
+#include <learnopengl/benchmark.h>
+#include <learnopengl/bloom.h>
+#include <learnopengl/hiz_buffer.h>
+#include <learnopengl/render_queue.h>
+#include <learnopengl/render_targets.h>
+#include <learnopengl/shadow_map.h>
+#include <learnopengl/clustered_lights.h>
+#include <learnopengl/cpu_profiler.h>
+#include <learnopengl/dynamic_resolution.h>
+#include <learnopengl/gpu_profiler.h>
+#include <learnopengl/scene.h>
+#include <learnopengl/uniform_buffer.h>
 
 #include <iostream>
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <memory>
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 
@@ -32,12 +52,28 @@ unsigned int loadCubemap(vector<std::string> faces);
 
 void renderQuad();
 
+bool waitForModels(GLFWwindow *window, vector<std::future<ModelData> *> models);
+
+void printModelMemory(const vector<std::pair<const char *, const Model *>> &models);
+
+void DrawImGui(const CullingStats &cullingStats, HiZBuffer &hiZ, ShadowMap &shadowMap, const ClusteredLights &clusteredLights,
+               Bloom &bloomChain, const RenderTargets &targets, DynamicResolution &dynamicResolution,
+               const GpuProfiler &gpuProfiler, const vector<const RenderQueue *> &queues);
+
 // settings
 const unsigned int SCR_WIDTH = 1600;
 const unsigned int SCR_HEIGHT = 900;
+// texture units of the lit programs above the ones the materials use: the sun's shadow map, and the
+// clustered lights (three units starting at LIGHT_CLUSTERS_UNIT)
+const unsigned int SHADOW_MAP_UNIT = 8;
+const unsigned int LIGHT_CLUSTERS_UNIT = 9;
 
 // camera
 
+// size of the window's framebuffer in pixels, kept up to date by framebuffer_size_callback
+unsigned int framebufferWidth = SCR_WIDTH;
+unsigned int framebufferHeight = SCR_HEIGHT;
+
 float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
@@ -49,31 +85,55 @@ float lastFrame = 0.0f;
 bool Blinn = false;
 bool TurnOnTheBrightLights = false;
 bool bloom = false;
+float bloomThreshold = 1.0f;
+float bloomIntensity = 0.25f;
 bool hdr=false;
 float exposure = 0.55f;
 bool spectatorMode = false;
 bool acceleration = false;
-
-struct SpotLight {
-    glm::vec3 position;
+bool pickRequested = false;
+bool occlusionCulling = true;
+bool showHiZ = false;
+bool depthPrepass = false;
+bool showOverdraw = false;
+bool shadows = true;
+bool deferredShading = false;
+int hiZDebugLevel = 0;
+int testLights = 0; // extra point lights around the asteroid belt, to see the clustered lighting scale
+
+// DirLight is uploaded as is into the LightData uniform block, its layout has to match std140
+// (see newShader.fs): every vec3 starts on 16 bytes. point and spot lights are ClusteredLights.
+struct DirLight{
     glm::vec3 direction;
-    float cutOff;
-    float outerCutOff;
-
-    float constant;
-    float linear;
-    float quadratic;
-
+    float padding0;
     glm::vec3 ambient;
+    float padding1;
     glm::vec3 diffuse;
+    float padding2;
     glm::vec3 specular;
+    float padding3;
 };
 
-struct DirLight{
-    glm::vec3 direction;
-    glm::vec3 ambient;
-    glm::vec3 diffuse;
-    glm::vec3 specular;
+// contents of the uniform blocks shared by all programs, written once per frame
+struct FrameData {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 viewPosition;
+    float bloomThreshold;
+};
+
+struct LightData {
+    DirLight dirLight;
+};
+
+static_assert(sizeof(FrameData) == 144 && sizeof(LightData) == 64, "uniform block structs have to match the std140 layout");
+
+// uniforms of the lit object shaders that differ per object, everything shared comes from the blocks
+struct LitShaderUniforms {
+    UniformHandle model;
+
+    explicit LitShaderUniforms(const Shader &shader)
+            : model(shader.uniform("model")) {}
 };
 
 struct ProgramState {
@@ -133,14 +193,33 @@ glm::vec3 xwingLightPosition = glm::vec3(0.0f);
 glm::vec3 xwingLightDirection = glm::vec3(0.0f, 0.0f, -1.0f);
 
 glm::vec3 xwingLBO = glm::vec3(-1.47279f, -0.757466f, 5.85636f); //left bottom light
+// the four engines are xwingLBO mirrored around the xwing's axes
+const glm::vec2 xwingEngineMirrors[] = {glm::vec2(1.0f, 1.0f), glm::vec2(1.0f, -1.0f), glm::vec2(-1.0f, -1.0f), glm::vec2(-1.0f, 1.0f)};
+
+int main(int argc, char **argv) {
+    // --bench flies a fixed path through the scene in a hidden window and writes frame time statistics
+    BenchmarkOptions benchmarkOptions;
+    if (!ParseBenchmarkOptions(argc, argv, benchmarkOptions))
+        return -1;
+    PROFILE_THREAD_NAME("main");
+    // --replay plays a recorded camera track instead of the live input, --record saves one on exit
+    std::unique_ptr<CameraTrack> replay, recording;
+    if (!benchmarkOptions.replayPath.empty()) {
+        replay.reset(new CameraTrack());
+        if (!replay->Load(benchmarkOptions.replayPath))
+            return -1;
+    } else if (!benchmarkOptions.recordPath.empty()) {
+        recording.reset(new CameraTrack());
+    }
 
-int main() {
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    if (benchmarkOptions.enabled)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
@@ -155,7 +234,14 @@ int main() {
         return -1;
     }
     glfwMakeContextCurrent(window);
+    // the benchmark measures the frames, not the display's refresh rate
+    if (benchmarkOptions.enabled)
+        glfwSwapInterval(0);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    int initialWidth, initialHeight;
+    glfwGetFramebufferSize(window, &initialWidth, &initialHeight);
+    framebufferWidth = initialWidth;
+    framebufferHeight = initialHeight;
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
     glfwSetKeyCallback(window, key_callback);
@@ -169,8 +255,22 @@ int main() {
         return -1;
     }
 
+    // start importing the models right away, parsing runs on worker threads while we set up the rest
+    // ------------------------------------------------------------------------------------------------
+    std::future<ModelData> xwingData = ModelLoader::loadAsync("resources/objects/xwing/XWing_Woody.obj");
+    std::future<ModelData> starDestroyerData = ModelLoader::loadAsync("resources/objects/starDestroyer/star_destroyer.obj");
+    std::future<ModelData> rebelShipData = ModelLoader::loadAsync("resources/objects/rebelShip/Vehicle_SpaceCraft_SW_CR90-Corvette.obj");
+    std::future<ModelData> asteroidFieldData = ModelLoader::loadAsync("resources/objects/asteroidField/asteroid_03_01.obj");
+
     programState = new ProgramState;
     programState->LoadFromFile("resources/program_state.txt");
+    if (benchmarkOptions.enabled) {
+        // the same work on every run: no overlay, and the full pipeline on
+        programState->ImGuiEnabled = false;
+        Blinn = true;
+        bloom = true;
+        hdr = true;
+    }
     if (programState->ImGuiEnabled) {
         glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
     }
@@ -200,20 +300,67 @@ int main() {
     Shader skyBoxShader("resources/shaders/skyBox.vs", "resources/shaders/skyBox.fs");
     Shader starDestroyerShader("resources/shaders/newShader.vs", "resources/shaders/newShader.fs");
     Shader rebelShipShader("resources/shaders/newShader.vs", "resources/shaders/newShader.fs");
-    Shader asteroidFieldShader("resources/shaders/oppositeShader.vs", "resources/shaders/newShader.fs");
+    Shader asteroidBeltShader("resources/shaders/asteroidBelt.vs", "resources/shaders/newShader.fs");
     Shader lightShader("resources/shaders/lightShader.vs", "resources/shaders/lightShader.fs");
-    Shader blurShader("resources/shaders/blur.vs", "resources/shaders/blur.fs");
+    Shader bloomDownsampleShader("resources/shaders/fullScreen.vs", "resources/shaders/bloomDownsample.fs");
+    Shader bloomUpsampleShader("resources/shaders/fullScreen.vs", "resources/shaders/bloomUpsample.fs");
     Shader hdrShader("resources/shaders/hdr.vs","resources/shaders/hdr.fs");
+    // depth prepass: the lit programs' vertex shaders with a fragment shader that writes nothing
+    Shader xwingDepthShader("resources/shaders/2.model_lighting.vs", "resources/shaders/depthOnly.fs");
+    Shader shipDepthShader("resources/shaders/newShader.vs", "resources/shaders/depthOnly.fs");
+    Shader asteroidDepthShader("resources/shaders/asteroidBelt.vs", "resources/shaders/depthOnly.fs");
+    // deferred shading: the lit programs' vertex shaders write the G-buffer, one full screen pass lights it
+    Shader xwingGBufferShader("resources/shaders/2.model_lighting.vs", "resources/shaders/gBuffer.fs");
+    Shader starDestroyerGBufferShader("resources/shaders/newShader.vs", "resources/shaders/gBuffer.fs");
+    Shader rebelShipGBufferShader("resources/shaders/newShader.vs", "resources/shaders/gBuffer.fs");
+    Shader asteroidGBufferShader("resources/shaders/asteroidBelt.vs", "resources/shaders/gBuffer.fs");
+    Shader deferredLightingShader("resources/shaders/fullScreen.vs", "resources/shaders/deferredLighting.fs");
+    Shader hiZShader("resources/shaders/fullScreen.vs", "resources/shaders/hiZDownsample.fs");
+    Shader hiZDebugShader("resources/shaders/fullScreen.vs", "resources/shaders/hiZDebug.fs");
     // load models
     // -----------
-    Model xwingModel("resources/objects/xwing/XWing_Woody.obj");
+    // show a loading frame until the workers are done, only the GPU upload happens here on the GL thread
+    if (!waitForModels(window, {&xwingData, &starDestroyerData, &rebelShipData, &asteroidFieldData})) {
+        // closed while loading, there is nothing to save yet
+        delete programState;
+        ImGui_ImplOpenGL3_Shutdown();
+        ImGui_ImplGlfw_Shutdown();
+        ImGui::DestroyContext();
+        glfwTerminate();
+        return 0;
+    }
+    if (benchmarkOptions.floatVertices)
+        Mesh::DefaultVertexFormat() = FLOAT_VERTICES;
+    Model xwingModel(xwingData.get());
     xwingModel.SetShaderTextureNamePrefix("material.");
-    Model starDestroyerModel("resources/objects/starDestroyer/star_destroyer.obj");
+    Model starDestroyerModel(starDestroyerData.get());
     starDestroyerModel.SetShaderTextureNamePrefix("material.");
-    Model rebelShipModel("resources/objects/rebelShip/Vehicle_SpaceCraft_SW_CR90-Corvette.obj");
+    Model rebelShipModel(rebelShipData.get());
     rebelShipModel.SetShaderTextureNamePrefix("material.");
-    Model asteroidFieldModel("resources/objects/asteroidField/asteroid_03_01.obj");
-    asteroidFieldModel.SetShaderTextureNamePrefix("material.");
+    // the rocks of the asteroid field are the shapes of the belt
+    Model asteroidPrototypes(asteroidFieldData.get());
+    asteroidPrototypes.SetShaderTextureNamePrefix("material.");
+    AsteroidBelt::Settings beltSettings;
+    beltSettings.count = 50000;
+    beltSettings.radius = 60.0f;
+    AsteroidBelt asteroidBelt(asteroidPrototypes, beltSettings);
+    printModelMemory({{"xwing", &xwingModel}, {"star destroyer", &starDestroyerModel}, {"rebel ship", &rebelShipModel},
+                      {"asteroids", &asteroidPrototypes}});
+
+    // the ships are placed in a Scene, its BVH culls their meshes and answers picking queries.
+    // the star destroyer and the rebel ship never move, the xwing is moved every frame.
+    glm::mat4 starDestroyerTransform = glm::mat4(1.0f);
+    starDestroyerTransform = glm::translate(starDestroyerTransform, glm::vec3(10.0f, -15.0f, -35.0f));
+    starDestroyerTransform = glm::scale(starDestroyerTransform, glm::vec3(0.2f));
+    glm::mat4 rebelShipTransform = glm::mat4(1.0f);
+    rebelShipTransform = glm::translate(rebelShipTransform, glm::vec3(37.0f, 5.0f, +25.0f));
+    rebelShipTransform = glm::scale(rebelShipTransform, glm::vec3(0.15f));
+    rebelShipTransform = glm::rotate(rebelShipTransform, glm::radians(180.0f), glm::vec3(1.0f, 0.0f, -0.5f));
+    Scene scene;
+    const unsigned int xwingObject = scene.Add(xwingModel, glm::mat4(1.0f), false);
+    const unsigned int starDestroyerObject = scene.Add(starDestroyerModel, starDestroyerTransform);
+    const unsigned int rebelShipObject = scene.Add(rebelShipModel, rebelShipTransform);
+    const char *objectNames[] = {"X-Wing", "Star Destroyer", "Rebel ship"};
 
     //skyBox
     float skyBoxVertices[] = {
@@ -260,20 +407,6 @@ int main() {
             1.0f, -1.0f,  1.0f
     };
 
-    //light
-    float lightVertices[] = {
-            //coordinates                     //normals                      //texture
-            1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, //top right
-            1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f,  //bottom right
-            -1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,  //bottom left
-            -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f //top left
-    };
-
-    unsigned int lightIndices[]={
-            0, 1, 3,
-            1, 2, 3
-    };
-
     unsigned int skyboxVAO, skyboxVBO;
     glGenVertexArrays(1, &skyboxVAO);
     glGenBuffers(1, &skyboxVBO);
@@ -284,69 +417,53 @@ int main() {
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 
 
-    unsigned int lightVAO, lightVBO, lightEBO;
-    glGenVertexArrays(1, &lightVAO);
-    glGenBuffers(1, &lightVBO);
-    glGenBuffers(1, &lightEBO);
-
-    glBindVertexArray(lightVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, lightVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(lightVertices), lightVertices, GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, lightEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(lightIndices), lightIndices, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), nullptr);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3*sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6*sizeof(float)));
-    glEnableVertexAttribArray(2);
-
-
-    unsigned int hdrFBO;
-    glGenFramebuffers(1, &hdrFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
-    unsigned int colorBuffers[2];
-    glGenTextures(2, colorBuffers);
-    for (unsigned int i = 0; i < 2; i++)
-    {
-        glBindTexture(GL_TEXTURE_2D, colorBuffers[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, colorBuffers[i], 0);
-    }
-
-    unsigned int rboDepth;
-    glGenRenderbuffers(1, &rboDepth);
-    glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, SCR_WIDTH, SCR_HEIGHT);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
-    unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-    glDrawBuffers(2, attachments);
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        std::cout << "Framebuffer not complete!" << std::endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    unsigned int pingpongFBO[2];
-    unsigned int pingpongColorbuffers[2];
-    glGenFramebuffers(2, pingpongFBO);
-    glGenTextures(2, pingpongColorbuffers);
-    for (unsigned int i = 0; i < 2; i++)
-    {
-        glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
-        glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pingpongColorbuffers[i], 0);
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-            std::cout << "Framebuffer not complete!" << std::endl;
+    // engine glows of the xwing, and any other light sprites, are drawn in one instanced call
+    BillboardRenderer billboards;
+    vector<BillboardInstance> lightSprites;
+
+    // every target the scene is drawn to follows the window's framebuffer size, see RenderTargets
+    RenderTargets targets(framebufferWidth, framebufferHeight);
+    const TargetFormat hdrFormat = {GL_RGBA16F, GL_RGBA, GL_FLOAT, GL_LINEAR};
+    const RenderTargets::TextureHandle sceneColor = targets.AddTexture(hdrFormat);
+    const RenderTargets::TextureHandle brightColor = targets.AddTexture(hdrFormat);
+    // depth is a texture, the hierarchical Z buffer is built from it
+    const RenderTargets::TextureHandle sceneDepth = targets.AddTexture({GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_FLOAT, GL_NEAREST});
+    // how many times the lighting shaders ran per pixel, only drawn to while the overdraw view is on
+    const RenderTargets::TextureHandle overdraw = targets.AddTexture({GL_R16F, GL_RED, GL_FLOAT, GL_NEAREST});
+    // G-buffer of the deferred path, only drawn to while it is on. the position comes from the depth.
+    const RenderTargets::TextureHandle gAlbedoSpecular = targets.AddTexture({GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, GL_NEAREST});
+    const RenderTargets::TextureHandle gNormalLight = targets.AddTexture({GL_RGBA16F, GL_RGBA, GL_FLOAT, GL_NEAREST});
+    const RenderTargets::FramebufferHandle hdrFBO = targets.AddFramebuffer({sceneColor, brightColor, overdraw, gAlbedoSpecular, gNormalLight}, sceneDepth);
+    // the deferred lighting pass samples the depth, so it draws through a framebuffer without it
+    const RenderTargets::FramebufferHandle deferredFBO = targets.AddFramebuffer({sceneColor, brightColor});
+    unsigned int attachments[5] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3, GL_COLOR_ATTACHMENT4 };
+    // full screen passes draw a triangle without vertex buffers
+    unsigned int fullScreenVAO;
+    glGenVertexArrays(1, &fullScreenVAO);
+
+    // occlusion culling against the depth of earlier frames
+    HiZBuffer hiZ(targets.Size().x, targets.Size().y);
+
+    // the glow around the bright parts of the frame
+    Bloom bloomChain;
+    // lowers the scene's resolution when the GPU can't keep up
+    DynamicResolution dynamicResolution;
+    // GPU time per pass, shown in the debug overlay
+    GpuProfiler gpuProfiler;
+    std::unique_ptr<Benchmark> benchmark;
+    if (benchmarkOptions.enabled || replay) {
+        // frame times at a changing resolution couldn't be compared between runs, and the scale follows live
+        // GPU timings, so two replays of a track wouldn't draw the same frames
+        DynamicResolution::Settings fixedResolution = dynamicResolution.GetSettings();
+        fixedResolution.enabled = false;
+        dynamicResolution.SetSettings(fixedResolution);
     }
+    if (benchmarkOptions.enabled)
+        benchmark.reset(new Benchmark(benchmarkOptions));
+    // the benchmark's lap: past the rebel ship, around the star destroyer and back through the asteroid belt
+    const CameraPath benchmarkPath({glm::vec3(7.0f, -1.5f, 55.0f), glm::vec3(45.0f, 12.0f, 50.0f), glm::vec3(65.0f, 0.0f, 10.0f),
+                                    glm::vec3(40.0f, -5.0f, -35.0f), glm::vec3(10.0f, 10.0f, -70.0f), glm::vec3(-35.0f, -5.0f, -45.0f),
+                                    glm::vec3(-55.0f, -15.0f, 0.0f), glm::vec3(-30.0f, -10.0f, 40.0f)}, 2.5f);
 
     vector <std::string> faces{
         "resources/textures/skybox/right.png",
@@ -361,15 +478,10 @@ int main() {
     unsigned int planetTexture = loadTexture("resources/textures/planetrotation.png");
     unsigned  int lightTexture = loadTexture("resources/textures/svetloYellow.png");
 
-    SpotLight spotLight;
-    spotLight.position = glm::vec3 (0.00577375,0.257113,-6.42628);
-    spotLight.direction = glm::vec3 (0.0f, 0.0f, -1.0f);
-    spotLight.ambient = glm::vec3 (0.0f);
-    spotLight.constant = 1.0f;
-    spotLight.linear = 0.01f;
-    spotLight.quadratic = 0.02f;
-    spotLight.cutOff = glm::cos(glm::radians(15.0f));
-    spotLight.outerCutOff = glm::cos(glm::radians(30.0f));
+    // the xwing's headlight, moved along with it every frame
+    ClusteredLight headlight = ClusteredLight::Spot(xwingLightPosition, xwingLightDirection, glm::vec3(5.0f, 0.2f, 0.2f),
+                                                    glm::cos(glm::radians(15.0f)), glm::cos(glm::radians(30.0f)), 0.01f, 0.02f, 0.9f);
+    ClusteredLights clusteredLights;
 
     DirLight sun;
     sun.direction = glm::vec3(1.0f, 0.0f, 0.0f);
@@ -386,200 +498,410 @@ int main() {
     lightShader.use();
     lightShader.setInt("texture", 0);
 
-    blurShader.use();
-    blurShader.setInt("image", 0);
-
     hdrShader.use();
     hdrShader.setInt("hdrBuffer", 0);
     hdrShader.setInt("bloomBlur", 1);
+    hdrShader.setInt("overdraw", 2);
+
+    // material settings that never change
+    for (Shader *shader : {&xwingShader, &starDestroyerShader, &rebelShipShader, &asteroidBeltShader,
+                           &xwingGBufferShader, &starDestroyerGBufferShader, &rebelShipGBufferShader, &asteroidGBufferShader}) {
+        shader->use();
+        shader->setFloat("material.shininess", 32.0f);
+        shader->setFloat("dirLightScale", 1.0f);
+        shader->setInt("shadowMap", SHADOW_MAP_UNIT);
+        shader->setInt("lights", LIGHT_CLUSTERS_UNIT);
+        shader->setInt("clusters", LIGHT_CLUSTERS_UNIT + 1);
+        shader->setInt("lightIndices", LIGHT_CLUSTERS_UNIT + 2);
+    }
+    // the rebel ship gets less direct sunlight
+    rebelShipShader.use();
+    rebelShipShader.setFloat("dirLightScale", 0.7f);
+    rebelShipGBufferShader.use();
+    rebelShipGBufferShader.setFloat("dirLightScale", 0.7f);
+    // every material has the same shininess, so the G-buffer doesn't store it
+    deferredLightingShader.use();
+    deferredLightingShader.setInt("gAlbedoSpecular", 0);
+    deferredLightingShader.setInt("gNormalLight", 1);
+    deferredLightingShader.setInt("gDepth", 2);
+    deferredLightingShader.setFloat("shininess", 32.0f);
+    deferredLightingShader.setInt("shadowMap", SHADOW_MAP_UNIT);
+    deferredLightingShader.setInt("lights", LIGHT_CLUSTERS_UNIT);
+    deferredLightingShader.setInt("clusters", LIGHT_CLUSTERS_UNIT + 1);
+    deferredLightingShader.setInt("lightIndices", LIGHT_CLUSTERS_UNIT + 2);
+
+    // camera and lights are shared by all programs through uniform blocks, updated once per frame
+    UniformBuffer<FrameData> frameData(FRAME_DATA_BINDING);
+    UniformBuffer<LightData> lightData(LIGHT_DATA_BINDING);
+    UniformBuffer<ShadowData> shadowData(SHADOW_DATA_BINDING);
+    UniformBuffer<ClusterData> clusterData(CLUSTER_DATA_BINDING);
+    for (Shader *shader : {&xwingShader, &starDestroyerShader, &rebelShipShader, &asteroidBeltShader, &lightShader, &skyBoxShader,
+                           &xwingDepthShader, &shipDepthShader, &asteroidDepthShader, &xwingGBufferShader, &starDestroyerGBufferShader,
+                           &rebelShipGBufferShader, &asteroidGBufferShader, &deferredLightingShader}) {
+        shader->bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+        shader->bindUniformBlock("LightData", LIGHT_DATA_BINDING);
+        shader->bindUniformBlock("ShadowData", SHADOW_DATA_BINDING);
+        shader->bindUniformBlock("ClusterData", CLUSTER_DATA_BINDING);
+    }
+
+    // the sun's shadows, the casters are drawn with the depth prepass programs
+    ShadowMap shadowMap;
+    RenderQueue shadowQueue(true);
+
+    // resolve the uniforms the render loop sets every frame
+    const LitShaderUniforms xwingUniforms(xwingShader);
+    const LitShaderUniforms starDestroyerUniforms(starDestroyerShader);
+    const LitShaderUniforms rebelShipUniforms(rebelShipShader);
+    const LitShaderUniforms asteroidBeltUniforms(asteroidBeltShader);
+    const LitShaderUniforms xwingGBufferUniforms(xwingGBufferShader);
+    const LitShaderUniforms starDestroyerGBufferUniforms(starDestroyerGBufferShader);
+    const LitShaderUniforms rebelShipGBufferUniforms(rebelShipGBufferShader);
+    const LitShaderUniforms asteroidGBufferUniforms(asteroidGBufferShader);
+    const UniformHandle deferredInverseViewProjection = deferredLightingShader.uniform("inverseViewProjection");
+    const UniformHandle deferredUVScale = deferredLightingShader.uniform("uvScale");
+    const UniformHandle hdrEnabled = hdrShader.uniform("hdr");
+    const UniformHandle hdrBloom = hdrShader.uniform("bloom");
+    const UniformHandle hdrExposure = hdrShader.uniform("exposure");
+    const UniformHandle hdrBloomIntensity = hdrShader.uniform("bloomIntensity");
+    const UniformHandle hdrUVScale = hdrShader.uniform("uvScale");
+    const UniformHandle hdrShowOverdraw = hdrShader.uniform("showOverdraw");
+    const UniformHandle xwingDepthModel = xwingDepthShader.uniform("model");
+    const UniformHandle shipDepthModel = shipDepthShader.uniform("model");
+    const UniformHandle asteroidDepthModel = asteroidDepthShader.uniform("model");
+    RenderQueue depthQueue(true);
+    RenderQueue opaqueQueue;
+    bool blinnUploaded = !Blinn;
+    // depth only program and its model uniform per scene object, for the shadow casters
+    Shader *casterShaders[] = {&xwingDepthShader, &shipDepthShader, &shipDepthShader};
+    const UniformHandle casterModels[] = {xwingDepthModel, shipDepthModel, shipDepthModel};
+    // queues the meshes of a scene object that survived culling
+    auto queueVisibleMeshes = [&scene](RenderQueue &queue, Shader &shader, UniformHandle modelUniform, Model &target,
+                                       const glm::mat4 &transform, unsigned int object) {
+        for (unsigned int mesh : scene.VisibleMeshes(object))
+            queue.Add(shader, target.meshes[mesh], transform, modelUniform);
+    };
+    // what the frustum culling skipped, shown in the window title
+    CullingStats cullingStats;
+    float titleUpdateTime = 0.0f;
+    unsigned int replayFrame = 0;
+    // the benchmark measures the scene, not textures still streaming in: every frame, warmup too, draws
+    // the final textures and no upload lands in a measured frame
+    if (benchmark)
+        TextureLoader::Get().Finish();
+
     // render loop
     // -----------
     while (!glfwWindowShouldClose(window)) {
+        PROFILE_SCOPE("Frame");
         // per-frame time logic
         // --------------------
         float currentFrame = glfwGetTime();
+        // replays and the benchmark run on a fixed timestep, every run draws the same frames however fast they come
+        if (replay)
+            currentFrame = replayFrame * replay->Timestep();
+        else if (benchmark)
+            currentFrame = benchmark->Frame() / 60.0f;
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
         // input
         // -----
-        processInput(window);
+        if (replay) {
+            if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+                glfwSetWindowShouldClose(window, true);
+            // the benchmark loops the track for as many frames as it was asked for
+            const CameraTrackFrame &state = replay->Frame(replayFrame % replay->FrameCount());
+            Camera &camera = programState->camera;
+            camera.Position = state.position;
+            camera.SetOrientation(state.yaw, state.pitch);
+            camera.Zoom = state.zoom;
+            Blinn = state.blinn;
+            bloom = state.bloom;
+            hdr = state.hdr;
+            spectatorMode = state.spectatorMode;
+            TurnOnTheBrightLights = state.headlight;
+            // in spectator mode the xwing stays where the frames before left it, as it did while recording
+            if (!spectatorMode) {
+                xwingPosition = camera.Position + xwingOffset;
+                xwingRotation.x = camera.Yaw + 90;
+                xwingRotation.y = camera.Pitch;
+            }
+        } else if (benchmark) {
+            glm::vec3 position, target;
+            benchmarkPath.Sample(currentFrame, position, target);
+            glm::vec3 direction = glm::normalize(target - position);
+            Camera &camera = programState->camera;
+            camera.Position = position;
+            camera.SetOrientation(glm::degrees(std::atan2(direction.z, direction.x)), glm::degrees(std::asin(direction.y)));
+            xwingPosition = camera.Position + xwingOffset;
+            xwingRotation.x = camera.Yaw + 90;
+            xwingRotation.y = camera.Pitch;
+        } else {
+            processInput(window);
+        }
+        if (recording) {
+            const Camera &camera = programState->camera;
+            CameraTrackFrame state;
+            state.position = camera.Position;
+            state.yaw = camera.Yaw;
+            state.pitch = camera.Pitch;
+            state.zoom = camera.Zoom;
+            state.blinn = Blinn;
+            state.bloom = bloom;
+            state.hdr = hdr;
+            state.spectatorMode = spectatorMode;
+            state.headlight = TurnOnTheBrightLights;
+            recording->Record(currentFrame, state);
+        }
+        if (benchmark)
+            benchmark->BeginFrame();
+
+        // finish textures decoded in the background since the last frame
+        TextureLoader::Get().ProcessUploads();
 
 
         // render
         // ------
+        dynamicResolution.BeginFrame();
+        gpuProfiler.BeginFrame();
         glClearColor(programState->clearColor.r, programState->clearColor.g, programState->clearColor.b, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         //hdr, postavljamo floating point buffer
-        glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
+        // a resize since the last frame reaches the targets here, they are reallocated as they are bound
+        targets.Resize(framebufferWidth, framebufferHeight);
+        const glm::ivec2 frameSize = targets.Size();
+        // the scene is drawn into the bottom left renderSize pixels of the targets, hdr.fs scales it up
+        targets.SetRenderScale(dynamicResolution.Scale());
+        const glm::ivec2 renderSize = targets.RenderSize();
+        hiZ.Resize(renderSize.x, renderSize.y);
+        targets.BindFramebuffer(hdrFBO);
+        glDrawBuffers(showOverdraw ? 3 : 2, attachments);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        if(TurnOnTheBrightLights){
-            spotLight.specular = glm::vec3 (0.9f);
-            spotLight.diffuse = glm::vec3 (5.0f, 0.2f, 0.2f);
-        }
-        else{
-            spotLight.specular = glm::vec3 (0.0f);
-            spotLight.diffuse = glm::vec3 (0.0f);
-        }
-        //X-Wing
-        xwingShader.use();
-        xwingShader.setVec3("dirLight.direction",sun.direction);
-        xwingShader.setVec3("dirLight.specular", sun.specular);
-        xwingShader.setVec3("dirLight.diffuse", sun.diffuse);
-        xwingShader.setVec3("dirLight.ambient", sun.ambient);
-        xwingShader.setVec3("viewPosition", programState->camera.Position);
-        xwingShader.setFloat("material.shininess", 32.0f);
-        xwingShader.setBool("Blinn", Blinn);
-
-        glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom),(float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 100.0f);
+        glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom),(float) frameSize.x / (float) frameSize.y, 0.1f, 100.0f);
         glm::mat4 view = programState->camera.GetViewMatrix();
 
-        xwingShader.setMat4("projection", projection);
-        xwingShader.setMat4("view", view);
-
         glm::mat4 model = glm::mat4(1.0f);
         model = glm::translate(model,xwingPosition);
         model = glm::scale(model, glm::vec3(0.9f));
         model = glm::rotate(model, glm::radians(xwingRotation.x), glm::vec3(0.0f, -1.0f, 0.0f));
         model = glm::rotate(model, glm::radians(xwingRotation.y), glm::vec3(1.0f, 0.0f, 0.0f));
-        xwingShader.setMat4("model", model);
-        xwingModel.Draw(xwingShader);
 
         if(!spectatorMode) {
             glm::vec4 xwingLightPosition2 = model * glm::vec4(xwingLightOffset, 1.0f);
             xwingLightPosition = glm::vec3(xwingLightPosition2);
             xwingLightDirection = programState->camera.Front;
         }
+        headlight.position = xwingLightPosition;
+        headlight.direction = xwingLightDirection;
+
+        scene.SetTransform(xwingObject, model);
+        //asteroid belt, around where the asteroid field used to be
+        glm::mat4 beltTransform = glm::mat4(1.0f);
+        beltTransform = glm::translate(beltTransform, glm::vec3(-10.0f, -15.f, 0.0f));
+
+        // sun shadows. every cascade is drawn with the depth only programs, the FrameData block holds the
+        // cascade's view and projection meanwhile. casters are culled per cascade.
+        shadowQueue.ResetStats();
+        if (shadows) {
+            PROFILE_SCOPE("Shadows");
+            gpuProfiler.Begin("Shadows");
+            shadowMap.Update(view, glm::radians(programState->camera.Zoom), (float) frameSize.x / (float) frameSize.y, 0.1f, 100.0f, sun.direction);
+            for (unsigned int cascade = 0; cascade < shadowMap.CascadeCount(); cascade++) {
+                FrameData lightFrame;
+                lightFrame.projection = shadowMap.Projection(cascade);
+                lightFrame.view = shadowMap.View(cascade);
+                lightFrame.viewPosition = programState->camera.Position;
+                lightFrame.bloomThreshold = bloomThreshold;
+                frameData.Update(lightFrame);
+
+                glm::mat4 lightViewProjection = shadowMap.ViewProjection(cascade);
+                shadowQueue.Begin(lightFrame.view, shadowMap.DepthRange(cascade));
+                scene.QueryFrustum(lightViewProjection, [&](unsigned int object, unsigned int mesh) {
+                    shadowQueue.Add(*casterShaders[object], scene.GetModel(object).meshes[mesh], scene.Transform(object), casterModels[object]);
+                });
+                asteroidBelt.Cull(Frustum(lightViewProjection * beltTransform));
+                asteroidBelt.Queue(shadowQueue, asteroidDepthShader, currentFrame, beltTransform, asteroidDepthModel);
+                shadowMap.BeginCascade(cascade);
+                shadowQueue.Submit();
+            }
+            shadowMap.End();
+            gpuProfiler.End();
+            targets.BindFramebuffer(hdrFBO);
+        }
+        shadowData.Update(shadowMap.Data(shadows));
+        shadowMap.Bind(SHADOW_MAP_UNIT);
+
+        // point and spot lights, binned into the clusters of the camera's frustum
+        clusteredLights.Clear();
+        if (TurnOnTheBrightLights)
+            clusteredLights.Add(headlight);
+        for (glm::vec2 mirror : xwingEngineMirrors) {
+            glm::vec3 engine = glm::vec3(model * glm::vec4(mirror.x * xwingLBO.x, mirror.y * xwingLBO.y, xwingLBO.z, 1.0f));
+            clusteredLights.Add(ClusteredLight::Point(engine, glm::vec3(1.0f, 0.45f, 0.2f), 0.7f, 1.8f, 0.3f));
+        }
+        for (int i = 0; i < testLights; i++) {
+            // spread over the belt, slowly orbiting
+            float angle = i * 2.39996f + currentFrame * 0.05f;
+            float distance = 60.0f + 12.0f * std::sin(i * 1.7f);
+            glm::vec3 position = glm::vec3(beltTransform * glm::vec4(std::cos(angle) * distance, 3.0f * std::sin(i * 0.9f), std::sin(angle) * distance, 1.0f));
+            glm::vec3 color = glm::vec3(0.5f + 0.5f * std::sin(i * 0.37f), 0.5f + 0.5f * std::sin(i * 0.37f + 2.1f), 0.5f + 0.5f * std::sin(i * 0.37f + 4.2f));
+            clusteredLights.Add(ClusteredLight::Point(position, color * 3.0f, 0.7f, 1.8f, 0.5f));
+        }
+        clusteredLights.Build(view, glm::radians(programState->camera.Zoom), (float) frameSize.x / (float) frameSize.y, 0.1f, 100.0f, renderSize.x, renderSize.y);
+        clusterData.Update(clusteredLights.Data());
+        clusteredLights.Bind(LIGHT_CLUSTERS_UNIT);
+
+        // shared uniforms for every program
+        FrameData frame;
+        frame.projection = projection;
+        frame.view = view;
+        frame.viewPosition = programState->camera.Position;
+        frame.bloomThreshold = bloomThreshold;
+        frameData.Update(frame);
+        LightData lights;
+        lights.dirLight = sun;
+        lightData.Update(lights);
+
+        // everything outside the view frustum is skipped, per mesh and per asteroid
+        glm::mat4 viewProjection = projection * view;
+        cullingStats.reset();
+        if (!occlusionCulling)
+            hiZ.Invalidate();
+        scene.Cull(viewProjection, &cullingStats, occlusionCulling ? &hiZ : nullptr);
+
+        if (pickRequested) {
+            pickRequested = false;
+            Scene::PickResult pick;
+            if (scene.Pick(programState->camera.Position, programState->camera.Front, 1000.0f, pick)) {
+                unsigned int nearby = 0;
+                glm::vec3 point = programState->camera.Position + programState->camera.Front * pick.distance;
+                scene.Nearby(point, 5.0f, [&](unsigned int, unsigned int) { nearby++; });
+                cout << "Picked " << objectNames[pick.object] << ", mesh " << pick.mesh << " at distance " << pick.distance
+                     << " (" << nearby << " meshes within 5 units)" << endl;
+            } else {
+                cout << "Picked nothing" << endl;
+            }
+        }
 
-        //Star Destroyer
-        starDestroyerShader.use();
-        starDestroyerShader.setVec3("dirLight.direction",sun.direction);
-        starDestroyerShader.setVec3("dirLight.specular", sun.specular);
-        starDestroyerShader.setVec3("dirLight.diffuse", sun.diffuse);
-        starDestroyerShader.setVec3("dirLight.ambient", sun.ambient);
-        starDestroyerShader.setVec3("viewPosition", programState->camera.Position);
-        starDestroyerShader.setFloat("material.shininess", 32.0f);
-        starDestroyerShader.setBool("Blinn", Blinn);
-
-        starDestroyerShader.setVec3("spotLight.position", xwingLightPosition);
-        starDestroyerShader.setVec3("spotLight.direction", xwingLightDirection);
-        starDestroyerShader.setVec3("spotLight.ambient", spotLight.ambient);
-        starDestroyerShader.setVec3("spotLight.diffuse", spotLight.diffuse);
-        starDestroyerShader.setVec3("spotLight.specular", spotLight.specular);
-        starDestroyerShader.setFloat("spotLight.constant", spotLight.constant);
-        starDestroyerShader.setFloat("spotLight.linear", spotLight.linear);
-        starDestroyerShader.setFloat("spotLight.quadratic", spotLight.quadratic);
-        starDestroyerShader.setFloat("spotLight.cutOff", spotLight.cutOff);
-        starDestroyerShader.setFloat("spotLight.outerCutOff", spotLight.outerCutOff);
-
-        starDestroyerShader.setMat4("projection", projection);
-        starDestroyerShader.setMat4("view", view);
-
-        glm::mat4 model2 = glm::mat4(1.0f);
-        model2 = glm::translate(model2, glm::vec3(10.0f, -15.0f, -35.0f));
-        model2 = glm::scale(model2, glm::vec3(0.2f));
-        starDestroyerShader.setMat4("model", model2);
-        starDestroyerModel.Draw(starDestroyerShader);
-        //rebel Ship
-        rebelShipShader.use();
-        rebelShipShader.setVec3("dirLight.direction",sun.direction);
-        rebelShipShader.setVec3("dirLight.specular", sun.specular);
-        rebelShipShader.setVec3("dirLight.diffuse", sun.diffuse*0.7f);
-        rebelShipShader.setVec3("dirLight.ambient", sun.ambient);
-        rebelShipShader.setVec3("viewPosition", programState->camera.Position);
-        rebelShipShader.setFloat("material.shininess", 32.0f);
-        rebelShipShader.setBool("Blinn", Blinn);
-
-        rebelShipShader.setVec3("spotLight.position", xwingLightPosition);
-        rebelShipShader.setVec3("spotLight.direction", xwingLightDirection);
-        rebelShipShader.setVec3("spotLight.ambient", spotLight.ambient);
-        rebelShipShader.setVec3("spotLight.diffuse", spotLight.diffuse);
-        rebelShipShader.setVec3("spotLight.specular", spotLight.specular);
-        rebelShipShader.setFloat("spotLight.constant", spotLight.constant);
-        rebelShipShader.setFloat("spotLight.linear", spotLight.linear);
-        rebelShipShader.setFloat("spotLight.quadratic", spotLight.quadratic);
-        rebelShipShader.setFloat("spotLight.cutOff", spotLight.cutOff);
-        rebelShipShader.setFloat("spotLight.outerCutOff", spotLight.outerCutOff);
-
-        rebelShipShader.setMat4("projection", projection);
-        rebelShipShader.setMat4("view", view);
-
-        model2 = glm::mat4(1.0f);
-        model2 = glm::translate(model2, glm::vec3(37.0f, 5.0f, +25.0f));
-        model2 = glm::scale(model2, glm::vec3(0.15f));
-        model2 = glm::rotate(model2, glm::radians(180.0f), glm::vec3(1.0f, 0.0f, -0.5f));
-        rebelShipShader.setMat4("model", model2);
-        rebelShipModel.Draw(rebelShipShader);
-
-        //asteroid Field
-        asteroidFieldShader.use();
-        asteroidFieldShader.setVec3("dirLight.direction",sun.direction);
-        asteroidFieldShader.setVec3("dirLight.specular", sun.specular);
-        asteroidFieldShader.setVec3("dirLight.diffuse", sun.diffuse);
-        asteroidFieldShader.setVec3("dirLight.ambient", sun.ambient);
-        asteroidFieldShader.setVec3("viewPosition", programState->camera.Position);
-        asteroidFieldShader.setFloat("material.shininess", 32.0f);
-        asteroidFieldShader.setBool("Blinn", Blinn);
-
-        asteroidFieldShader.setVec3("spotLight.position", xwingLightPosition);
-        asteroidFieldShader.setVec3("spotLight.direction", xwingLightDirection);
-        asteroidFieldShader.setVec3("spotLight.ambient", spotLight.ambient);
-        asteroidFieldShader.setVec3("spotLight.diffuse", spotLight.diffuse);
-        asteroidFieldShader.setVec3("spotLight.specular", spotLight.specular);
-        asteroidFieldShader.setFloat("spotLight.constant", spotLight.constant);
-        asteroidFieldShader.setFloat("spotLight.linear", spotLight.linear);
-        asteroidFieldShader.setFloat("spotLight.quadratic", spotLight.quadratic);
-        asteroidFieldShader.setFloat("spotLight.cutOff", spotLight.cutOff);
-        asteroidFieldShader.setFloat("spotLight.outerCutOff", spotLight.outerCutOff);
-
-        asteroidFieldShader.setMat4("projection", projection);
-        asteroidFieldShader.setMat4("view", view);
-
-        model2 = glm::mat4(1.0f);
-        model2 = glm::translate(model2, glm::vec3(-10.0f, -15.f, 0.0f));
-        asteroidFieldShader.setMat4("model", model2);
-        asteroidFieldModel.Draw(asteroidFieldShader);
+        // the shadow passes culled the belt for themselves, this is the camera's
+        asteroidBelt.Cull(Frustum(viewProjection * beltTransform), &cullingStats,
+                          occlusionCulling ? hiZ.MakeTest(beltTransform) : HiZBuffer::Test());
+
+        // Blinn is a uniform of every lit program, only uploaded when it changes
+        if (Blinn != blinnUploaded) {
+            blinnUploaded = Blinn;
+            for (Shader *shader : {&xwingShader, &starDestroyerShader, &rebelShipShader, &asteroidBeltShader, &deferredLightingShader}) {
+                shader->use();
+                shader->setBool("Blinn", Blinn);
+            }
+        }
+
+        // the draws are collected and sorted to change program, textures and vertex arrays as rarely as possible
+        depthQueue.ResetStats();
+        opaqueQueue.ResetStats();
+        if (depthPrepass) {
+            depthQueue.Begin(view, 100.0f);
+            queueVisibleMeshes(depthQueue, xwingDepthShader, xwingDepthModel, xwingModel, model, xwingObject);
+            queueVisibleMeshes(depthQueue, shipDepthShader, shipDepthModel, starDestroyerModel, starDestroyerTransform, starDestroyerObject);
+            queueVisibleMeshes(depthQueue, shipDepthShader, shipDepthModel, rebelShipModel, rebelShipTransform, rebelShipObject);
+            asteroidBelt.Queue(depthQueue, asteroidDepthShader, currentFrame, beltTransform, asteroidDepthModel);
+
+            PROFILE_SCOPE("Depth prepass");
+            // depth only first, the lighting shaders below then run once per pixel (GL_EQUAL) instead of
+            // for every surface that is drawn before the closest one
+            gpuProfiler.Begin("Depth prepass");
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            depthQueue.Submit();
+            gpuProfiler.End();
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+        if (showOverdraw) {
+            // only the counter is blended
+            glEnablei(GL_BLEND, 2);
+            glBlendFunc(GL_ONE, GL_ONE);
+        }
+
+        opaqueQueue.Begin(view, 100.0f);
+        if (deferredShading) {
+            // only the surfaces into the G-buffer (and the overdraw counter), they are lit below
+            queueVisibleMeshes(opaqueQueue, xwingGBufferShader, xwingGBufferUniforms.model, xwingModel, model, xwingObject);
+            queueVisibleMeshes(opaqueQueue, starDestroyerGBufferShader, starDestroyerGBufferUniforms.model, starDestroyerModel, starDestroyerTransform, starDestroyerObject);
+            queueVisibleMeshes(opaqueQueue, rebelShipGBufferShader, rebelShipGBufferUniforms.model, rebelShipModel, rebelShipTransform, rebelShipObject);
+            asteroidBelt.Queue(opaqueQueue, asteroidGBufferShader, currentFrame, beltTransform, asteroidGBufferUniforms.model);
+            unsigned int gBufferAttachments[5] = { GL_NONE, GL_NONE, (unsigned int) (showOverdraw ? GL_COLOR_ATTACHMENT2 : GL_NONE), GL_COLOR_ATTACHMENT3, GL_COLOR_ATTACHMENT4 };
+            glDrawBuffers(5, gBufferAttachments);
+        } else {
+            queueVisibleMeshes(opaqueQueue, xwingShader, xwingUniforms.model, xwingModel, model, xwingObject);
+            queueVisibleMeshes(opaqueQueue, starDestroyerShader, starDestroyerUniforms.model, starDestroyerModel, starDestroyerTransform, starDestroyerObject);
+            queueVisibleMeshes(opaqueQueue, rebelShipShader, rebelShipUniforms.model, rebelShipModel, rebelShipTransform, rebelShipObject);
+            asteroidBelt.Queue(opaqueQueue, asteroidBeltShader, currentFrame, beltTransform, asteroidBeltUniforms.model);
+        }
+        gpuProfiler.Begin(deferredShading ? "G-buffer" : "Opaque");
+        opaqueQueue.Submit();
+        gpuProfiler.End();
+
+        if (depthPrepass) {
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+        }
+        if (showOverdraw) {
+            glDisablei(GL_BLEND, 2);
+            glDrawBuffers(2, attachments);
+        }
+        if (deferredShading) {
+            // lights every pixel the G-buffer pass covered, into the same targets the forward path draws to
+            PROFILE_SCOPE("Deferred lighting");
+            gpuProfiler.Begin("Deferred lighting");
+            glDrawBuffers(2, attachments);
+            targets.BindFramebuffer(deferredFBO);
+            glDisable(GL_DEPTH_TEST);
+            deferredLightingShader.use();
+            deferredLightingShader.setMat4(deferredInverseViewProjection, glm::inverse(viewProjection));
+            deferredLightingShader.setVec2(deferredUVScale, targets.UVScale());
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, targets.Texture(gAlbedoSpecular));
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, targets.Texture(gNormalLight));
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, targets.Texture(sceneDepth));
+            glActiveTexture(GL_TEXTURE0);
+            glBindVertexArray(fullScreenVAO);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glBindVertexArray(0);
+            glEnable(GL_DEPTH_TEST);
+            targets.BindFramebuffer(hdrFBO);
+            gpuProfiler.End();
+        }
 
         //lightTexture
+        gpuProfiler.Begin("Light sprites");
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, lightTexture);
+        glBindTexture(GL_TEXTURE_2D, TextureCache::Get().Resolve(lightTexture));
         lightShader.use();
-        lightShader.setMat4("projection", projection);
-        lightShader.setMat4("view", view);
-
-        glm::mat4 modellb = glm::translate(model,xwingLBO);
-        modellb = glm::scale(modellb, glm::vec3(0.24f));
-        lightShader.setMat4("model", modellb);
-        glBindVertexArray(lightVAO);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
-        glm::mat4 modellt = glm::translate(model,glm::vec3(xwingLBO.x, -xwingLBO.y, xwingLBO.z));
-        modellt = glm::scale(modellt, glm::vec3(0.24f));
-        lightShader.setMat4("model", modellt);
-        glBindVertexArray(lightVAO);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
-        glm::mat4 modelrt = glm::translate(model,glm::vec3(-xwingLBO.x, -xwingLBO.y, xwingLBO.z));
-        modelrt = glm::scale(modelrt, glm::vec3(0.24f));
-        lightShader.setMat4("model", modelrt);
-        glBindVertexArray(lightVAO);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
-        glm::mat4 modelrb = glm::translate(model,glm::vec3(-xwingLBO.x, xwingLBO.y, xwingLBO.z));
-        modelrb = glm::scale(modelrb, glm::vec3(0.24f));
-        lightShader.setMat4("model", modelrb);
-        glBindVertexArray(lightVAO);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+
+        // one sprite per engine, mirrored around the xwing's axes
+        lightSprites.clear();
+        for (glm::vec2 mirror : xwingEngineMirrors) {
+            BillboardInstance sprite;
+            sprite.model = glm::translate(model, glm::vec3(mirror.x * xwingLBO.x, mirror.y * xwingLBO.y, xwingLBO.z));
+            sprite.model = glm::scale(sprite.model, glm::vec3(0.24f));
+            lightSprites.push_back(sprite);
+        }
+        billboards.Draw(lightSprites);
+        gpuProfiler.End();
 
         //planetTexture
         glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, planetTexture);
+        glBindTexture(GL_TEXTURE_2D, TextureCache::Get().Resolve(planetTexture));
 
         // draw skybox as last
+        gpuProfiler.Begin("Skybox");
         glDepthFunc(GL_LEQUAL);
         skyBoxShader.use();
-        view = glm::mat4(glm::mat3(programState->camera.GetViewMatrix()));
-        skyBoxShader.setMat4("view", view);
-        skyBoxShader.setMat4("projection", projection);
         // skybox cube
         glBindVertexArray(skyboxVAO);
         glActiveTexture(GL_TEXTURE0);
@@ -588,58 +910,115 @@ int main() {
         glBindVertexArray(0);
         glBindTexture(GL_TEXTURE_2D, 0);
         glDepthFunc(GL_LESS);
+        gpuProfiler.End();
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        //bloom part
-        bool horizontal = true, first_iteration = true;
-        unsigned int amount = 10;
-        blurShader.use();
-        for (unsigned int i = 0; i < amount; i++)
-        {
-            glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
-            blurShader.setInt("horizontal", horizontal);
-            glBindTexture(GL_TEXTURE_2D, first_iteration ? colorBuffers[1] : pingpongColorbuffers[!horizontal]);  // bind texture of other framebuffer (or scene if first iteration)
-            renderQuad();
-            horizontal = !horizontal;
-            if (first_iteration)
-                first_iteration = false;
+        // this frame's depth is what the next frames cull against
+        if (occlusionCulling) {
+            gpuProfiler.Begin("Hi-Z");
+            hiZ.Build(hiZShader, targets.Texture(sceneDepth), viewProjection);
+            gpuProfiler.End();
         }
+
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        // bloom from the bright parts the lit programs wrote to the second color buffer
+        unsigned int bloomTexture = 0;
+        if (bloom && !showOverdraw) {
+            gpuProfiler.Begin("Bloom");
+            bloomTexture = bloomChain.Render(targets, bloomDownsampleShader, bloomUpsampleShader, targets.Texture(brightColor));
+            gpuProfiler.End();
+        }
 
         //hdr post-processing effect
+        gpuProfiler.Begin("HDR composite");
+        glViewport(0, 0, frameSize.x, frameSize.y);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         hdrShader.use();
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, colorBuffers[0]);
+        glBindTexture(GL_TEXTURE_2D, targets.Texture(sceneColor));
         glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[!horizontal]);
-        hdrShader.setInt("hdr", hdr);
-        hdrShader.setInt("bloom", bloom);
-        hdrShader.setFloat("exposure", exposure);
+        glBindTexture(GL_TEXTURE_2D, bloomTexture);
+        hdrShader.setInt(hdrEnabled, hdr);
+        hdrShader.setInt(hdrBloom, bloom);
+        hdrShader.setBool(hdrShowOverdraw, showOverdraw);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, targets.Texture(overdraw));
+        glActiveTexture(GL_TEXTURE0);
+        hdrShader.setFloat(hdrExposure, exposure);
+        hdrShader.setFloat(hdrBloomIntensity, bloomIntensity);
+        hdrShader.setVec2(hdrUVScale, targets.UVScale());
         renderQuad();
+        gpuProfiler.End();
+        if (bloomTexture)
+            targets.Release(bloomTexture);
+        targets.EndFrame();
+
+        if (programState->ImGuiEnabled) {
+            PROFILE_SCOPE("ImGui");
+            gpuProfiler.Begin("ImGui");
+            if (showHiZ)
+                hiZ.DrawDebug(hiZDebugShader, hiZDebugLevel, 0.1f, 100.0f);
+            DrawImGui(cullingStats, hiZ, shadowMap, clusteredLights, bloomChain, targets, dynamicResolution, gpuProfiler,
+                      {&shadowQueue, &depthQueue, &opaqueQueue});
+            gpuProfiler.End();
+        }
+        gpuProfiler.EndFrame();
+        dynamicResolution.EndFrame();
+        if (benchmark) {
+            benchmark->EndFrame();
+            if (benchmark->Finished())
+                glfwSetWindowShouldClose(window, true);
+        } else if (replay && replayFrame + 1 >= replay->FrameCount()) {
+            glfwSetWindowShouldClose(window, true);
+        }
+        replayFrame++;
+
+        if (currentFrame - titleUpdateTime > 0.5f) {
+            titleUpdateTime = currentFrame;
+            char title[160];
+            snprintf(title, sizeof(title), "LearnOpenGL - meshes %u/%u, asteroids %u/%u drawn, %u/%u occluded",
+                     cullingStats.meshesDrawn, cullingStats.meshesTested, cullingStats.instancesDrawn, cullingStats.instancesTested,
+                     cullingStats.meshesOccluded, cullingStats.instancesOccluded);
+            glfwSetWindowTitle(window, title);
+        }
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
+        {
+            PROFILE_SCOPE("Swap buffers");
+            glfwSwapBuffers(window);
+        }
         glfwPollEvents();
     }
 
-    programState->SaveToFile("resources/program_state.txt");
+    int exitCode = 0;
+    if (benchmark) {
+        benchmark->Finish();
+        if (!benchmark->WriteResults(framebufferWidth, framebufferHeight))
+            exitCode = 1;
+        benchmark.reset();
+    } else {
+        programState->SaveToFile("resources/program_state.txt");
+    }
+    if (!benchmarkOptions.tracePath.empty())
+        PROFILE_WRITE_TRACE(benchmarkOptions.tracePath);
+    if (recording && recording->Save(benchmarkOptions.recordPath))
+        std::cout << "Recorded " << recording->FrameCount() << " frames to " << benchmarkOptions.recordPath << std::endl;
     delete programState;
+    const TextureCache::Stats &textureStats = TextureCache::Get().GetStats();
+    std::cout << "Texture cache: " << textureStats.textures << " textures, " << textureStats.bytesResident / (1024 * 1024)
+              << " MB resident, " << textureStats.hits << " hits, " << textureStats.misses << " misses" << std::endl;
+    TextureCache::Get().ReleaseAll();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glDeleteVertexArrays(1, &skyboxVAO);
-    glDeleteVertexArrays(1, &lightVAO);
     glDeleteBuffers(1, &skyboxVAO);
-    glDeleteBuffers(1, &lightVBO);
-    glDeleteVertexArrays(1, &lightEBO);
 
 
     glfwTerminate();
-    return 0;
+    return exitCode;
 }
 
 
@@ -672,6 +1051,68 @@ void renderQuad()
     glBindVertexArray(0);
 }
 
+// renders a loading screen with a progress bar until all models have been imported.
+// false if the window was closed before that.
+// ----------------------------------------------------------------------------------
+bool waitForModels(GLFWwindow *window, vector<std::future<ModelData> *> models)
+{
+    while (!glfwWindowShouldClose(window)) {
+        unsigned int ready = 0;
+        for (std::future<ModelData> *model : models) {
+            if (model->wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+                ready++;
+        }
+        if (ready == models.size())
+            return true;
+
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        ImGui_ImplOpenGL3_NewFrame();
+        ImGui_ImplGlfw_NewFrame();
+        ImGui::NewFrame();
+        ImVec2 displaySize = ImGui::GetIO().DisplaySize;
+        ImGui::SetNextWindowPos(ImVec2(displaySize.x * 0.5f, displaySize.y * 0.5f), ImGuiCond_Always, ImVec2(0.5f, 0.5f));
+        ImGui::Begin("Loading", nullptr, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize);
+        ImGui::Text("Loading models... (%u/%u)", ready, (unsigned int) models.size());
+        ImGui::ProgressBar((float) ready / models.size(), ImVec2(300.0f, 0.0f));
+        ImGui::End();
+        ImGui::Render();
+        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+        // don't spin, the workers need the cores more than we do
+        for (std::future<ModelData> *model : models) {
+            if (model->wait_for(std::chrono::milliseconds(15)) != std::future_status::ready)
+                break;
+        }
+    }
+    return false;
+}
+
+// prints the vertex and index memory of the models, and what a vertex costs the lit and the depth only passes
+// ---------------------------------------------------------------------------------------------------------
+void printModelMemory(const vector<std::pair<const char *, const Model *>> &models)
+{
+    VertexFormat format = Mesh::DefaultVertexFormat();
+    printf("Vertex format %s: %u bytes a vertex, a lit draw fetches %u and a depth only draw %u (float layout %u/%u)\n",
+           format == PACKED_VERTICES ? "packed" : "float", Mesh::VertexBytes(format), Mesh::FetchBytes(format, false),
+           Mesh::FetchBytes(format, true), Mesh::FetchBytes(FLOAT_VERTICES, false), Mesh::FetchBytes(FLOAT_VERTICES, true));
+    Model::MemoryStats total;
+    for (const std::pair<const char *, const Model *> &model : models) {
+        Model::MemoryStats stats = model.second->Memory();
+        printf("  %-16s %9zu vertices %7.2f MB (float %7.2f MB), %9zu indices %7.2f MB\n", model.first, stats.vertices,
+               stats.vertexBytes / 1048576.0, stats.floatVertexBytes / 1048576.0, stats.indices, stats.indexBytes / 1048576.0);
+        total.vertices += stats.vertices;
+        total.indices += stats.indices;
+        total.vertexBytes += stats.vertexBytes;
+        total.floatVertexBytes += stats.floatVertexBytes;
+        total.indexBytes += stats.indexBytes;
+    }
+    printf("  %-16s %9zu vertices %7.2f MB (float %7.2f MB), %9zu indices %7.2f MB\n", "total", total.vertices,
+           total.vertexBytes / 1048576.0, total.floatVertexBytes / 1048576.0, total.indices, total.indexBytes / 1048576.0);
+}
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 // ---------------------------------------------------------------------------------------------------------
@@ -699,6 +1140,11 @@ void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
     // make sure the viewport matches the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
     glViewport(0, 0, width, height);
+    // the render targets follow at the start of the next frame. a minimized window reports 0, keep the last size
+    if (width > 0 && height > 0) {
+        framebufferWidth = width;
+        framebufferHeight = height;
+    }
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -752,6 +1198,29 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
         spectatorMode = true;
     }
 
+    // pick the mesh in the middle of the screen, handled in the render loop
+    if(key == GLFW_KEY_P && action == GLFW_PRESS){
+        pickRequested = true;
+    }
+
+    if(key == GLFW_KEY_O && action == GLFW_PRESS){
+        occlusionCulling = !occlusionCulling;
+    }
+
+    if(key == GLFW_KEY_Z && action == GLFW_PRESS){
+        depthPrepass = !depthPrepass;
+    }
+
+    if(key == GLFW_KEY_G && action == GLFW_PRESS){
+        deferredShading = !deferredShading;
+    }
+
+    if(key == GLFW_KEY_F1 && action == GLFW_PRESS){
+        programState->ImGuiEnabled = !programState->ImGuiEnabled;
+        programState->CameraMouseMovementUpdateEnabled = !programState->ImGuiEnabled;
+        glfwSetInputMode(window, GLFW_CURSOR, programState->ImGuiEnabled ? GLFW_CURSOR_NORMAL : GLFW_CURSOR_DISABLED);
+    }
+
     if(key == GLFW_KEY_LEFT_SHIFT && action == GLFW_PRESS){
         if(!acceleration){
             acceleration = true;
@@ -763,69 +1232,137 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
         }
     }
 }
+// both loaders return right away (shared through the TextureCache), the images are decoded on
+// worker threads and uploaded by TextureLoader::ProcessUploads in the render loop
 unsigned int loadTexture(char const * path)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT); // for this tutorial: use GL_CLAMP_TO_EDGE to prevent semi-transparent borders. Due to interpolation it takes texels from next repeat
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    // for this tutorial: use GL_CLAMP_TO_EDGE for RGBA images to prevent semi-transparent borders. Due to interpolation it takes texels from next repeat
+    return TextureCache::Get().Acquire(path, true);
 }
 
 unsigned int loadCubemap(vector<std::string> faces)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    return TextureCache::Get().AcquireCubemap(faces);
+}
 
-    int width, height, nrChannels;
-    for (unsigned int i = 0; i < faces.size(); i++)
-    {
-        unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
+// debug window, toggled with F1: culling statistics and a view of the hierarchical Z buffer
+// ------------------------------------------------------------------------------------------
+void DrawImGui(const CullingStats &cullingStats, HiZBuffer &hiZ, ShadowMap &shadowMap, const ClusteredLights &clusteredLights,
+               Bloom &bloomChain, const RenderTargets &targets, DynamicResolution &dynamicResolution,
+               const GpuProfiler &gpuProfiler, const vector<const RenderQueue *> &queues)
+{
+    ImGui_ImplOpenGL3_NewFrame();
+    ImGui_ImplGlfw_NewFrame();
+    ImGui::NewFrame();
+
+    ImGui::Begin("Debug");
+    ImGui::Text("Frame: %.2f ms", 1000.0f / ImGui::GetIO().Framerate);
+    ImGui::Text("Meshes: %u/%u drawn, %u occluded", cullingStats.meshesDrawn, cullingStats.meshesTested, cullingStats.meshesOccluded);
+    ImGui::Text("Asteroids: %u/%u drawn, %u occluded", cullingStats.instancesDrawn, cullingStats.instancesTested, cullingStats.instancesOccluded);
+    GLStateCache::Stats calls;
+    for (const RenderQueue *queue : queues) {
+        calls.drawCalls += queue->Stats().drawCalls;
+        calls.programChanges += queue->Stats().programChanges;
+        calls.textureChanges += queue->Stats().textureChanges;
+        calls.vertexArrayChanges += queue->Stats().vertexArrayChanges;
+        calls.redundantSkipped += queue->Stats().redundantSkipped;
+    }
+    ImGui::Text("Draw calls: %u, program changes: %u, texture binds: %u, VAO binds: %u, redundant skipped: %u",
+                calls.drawCalls, calls.programChanges, calls.textureChanges, calls.vertexArrayChanges, calls.redundantSkipped);
+    ImGui::Checkbox("Occlusion culling (O)", &occlusionCulling);
+    ImGui::Checkbox("Depth prepass (Z)", &depthPrepass);
+    ImGui::Checkbox("Deferred shading (G)", &deferredShading);
+    ImGui::Checkbox("Overdraw heat map", &showOverdraw);
+    const ClusteredLights::Stats &lightStats = clusteredLights.GetStats();
+    ImGui::Text("Lights: %u, %u in view, %u cluster entries (max %u per cluster), built in %.2f ms", lightStats.lights,
+                lightStats.visibleLights, lightStats.references, lightStats.maxPerCluster, lightStats.buildMilliseconds);
+    ImGui::SliderInt("Test lights", &testLights, 0, 2048);
+    ImGui::Checkbox("Sun shadows", &shadows);
+    if (shadows) {
+        ShadowMap::Settings settings = shadowMap.GetSettings();
+        int cascades = settings.cascadeCount;
+        int resolution = settings.resolution >= 4096 ? 2 : settings.resolution >= 2048 ? 1 : 0;
+        const char *resolutions[] = {"1024", "2048", "4096"};
+        bool changed = ImGui::SliderInt("Cascades", &cascades, 1, ShadowMap::MAX_CASCADES);
+        changed |= ImGui::Combo("Shadow map size", &resolution, resolutions, 3);
+        if (changed) {
+            settings.cascadeCount = cascades;
+            settings.resolution = 1024u << resolution;
+            shadowMap.SetSettings(settings);
         }
-        else
-        {
-            std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
+        ImGui::Text("Shadow map: %u MB", (unsigned int) (shadowMap.MemoryUsage() / (1024 * 1024)));
+    }
+    ImGui::Checkbox("Bloom (M)", &bloom);
+    if (bloom) {
+        Bloom::Settings settings = bloomChain.GetSettings();
+        int levels = settings.levels;
+        bool changed = ImGui::SliderInt("Bloom levels", &levels, 1, Bloom::MAX_LEVELS);
+        changed |= ImGui::SliderFloat("Bloom radius", &settings.filterRadius, 0.5f, 3.0f);
+        if (changed) {
+            settings.levels = levels;
+            bloomChain.SetSettings(settings);
         }
+        ImGui::SliderFloat("Bloom threshold", &bloomThreshold, 0.0f, 4.0f);
+        ImGui::SliderFloat("Bloom intensity", &bloomIntensity, 0.0f, 1.0f);
     }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    return textureID;
-}
\ No newline at end of file
+    DynamicResolution::Settings resolution = dynamicResolution.GetSettings();
+    bool resolutionChanged = ImGui::Checkbox("Dynamic resolution", &resolution.enabled);
+    if (resolution.enabled) {
+        resolutionChanged |= ImGui::SliderFloat("GPU budget (ms)", &resolution.targetMilliseconds, 4.0f, 50.0f);
+        resolutionChanged |= ImGui::SliderFloat("Min scale", &resolution.minScale, 0.25f, 1.0f);
+    }
+    if (resolutionChanged)
+        dynamicResolution.SetSettings(resolution);
+    ImGui::Text("Scene resolution: %dx%d (%.0f%%), GPU %.2f ms", targets.RenderSize().x, targets.RenderSize().y,
+                dynamicResolution.Scale() * 100.0f, dynamicResolution.GpuMilliseconds());
+    RenderTargets::MemoryStats targetMemory = targets.GetMemoryStats();
+    ImGui::Text("Render targets: %dx%d, %.1f MB + %.1f MB pooled (%u textures, %u in use), %u reallocations",
+                targets.Size().x, targets.Size().y, targetMemory.persistentBytes / (1024.0f * 1024.0f), targetMemory.poolBytes / (1024.0f * 1024.0f),
+                targetMemory.pooledTextures, targetMemory.pooledInUse, targetMemory.reallocations);
+    ImGui::Checkbox("Show Hi-Z", &showHiZ);
+    if (showHiZ) {
+        ImGui::SliderInt("Level", &hiZDebugLevel, 0, hiZ.levelCount - 1);
+        glm::ivec2 size = hiZ.DebugSize();
+        float width = 400.0f;
+        // flipped, GL textures start at the bottom
+        ImGui::Image((void *) (intptr_t) hiZ.DebugTexture, ImVec2(width, width * size.y / size.x), ImVec2(0.0f, 1.0f), ImVec2(1.0f, 0.0f));
+    }
+    ImGui::End();
+
+    // the frame's GPU time over the last frames, and split into its passes: one strip with a box per pass as
+    // wide as its share, and the numbers below
+    ImGui::Begin("GPU profiler");
+    const vector<GpuProfiler::Track> &tracks = gpuProfiler.Tracks();
+    float gpuTotal = 0.0f;
+    for (const GpuProfiler::Track &track : tracks)
+        gpuTotal += track.average;
+    ImGui::Text("GPU: %.2f ms, %u frames dropped", gpuTotal, gpuProfiler.DroppedFrames());
+    ImGui::PlotLines("##gpuTotal", gpuProfiler.TotalHistory(), GpuProfiler::HISTORY, gpuProfiler.HistoryOffset(), nullptr,
+                     0.0f, FLT_MAX, ImVec2(ImGui::GetContentRegionAvail().x, 60.0f));
+    ImDrawList *drawList = ImGui::GetWindowDrawList();
+    ImVec2 strip = ImGui::GetCursorScreenPos();
+    float stripWidth = ImGui::GetContentRegionAvail().x, stripHeight = 24.0f;
+    float x = strip.x;
+    auto passColor = [](unsigned int pass) { return ImColor::HSV(std::fmod(pass * 0.13f, 1.0f), 0.6f, 0.85f); };
+    for (unsigned int i = 0; i < tracks.size(); i++) {
+        float passWidth = gpuTotal > 0.0f ? stripWidth * tracks[i].average / gpuTotal : 0.0f;
+        drawList->AddRectFilled(ImVec2(x, strip.y), ImVec2(x + passWidth, strip.y + stripHeight), passColor(i));
+        if (ImGui::IsMouseHoveringRect(ImVec2(x, strip.y), ImVec2(x + passWidth, strip.y + stripHeight)))
+            ImGui::SetTooltip("%s: %.2f ms", tracks[i].name.c_str(), tracks[i].average);
+        x += passWidth;
+    }
+    ImGui::Dummy(ImVec2(stripWidth, stripHeight));
+    for (unsigned int i = 0; i < tracks.size(); i++)
+        ImGui::TextColored(passColor(i), "%-18s %6.2f ms (last %.2f)", tracks[i].name.c_str(),
+                           tracks[i].average, tracks[i].milliseconds);
+    if (ImGui::Button("Write CSV"))
+        gpuProfiler.WriteCsv("gpu_profile.csv");
+    ImGui::SameLine();
+    // the CPU side, every thread's PROFILE_SCOPEs
+    if (ImGui::Button("Write CPU trace"))
+        PROFILE_WRITE_TRACE("trace.json");
+    ImGui::End();
+
+    ImGui::Render();
+    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+}
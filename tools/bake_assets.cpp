@@ -0,0 +1,474 @@
+// bake_assets: converts every texture the scene uses into a block compressed KTX file with a precomputed
+// mip chain, written next to the source image as <image>.ktx (see learnopengl/ktx_format.h).
+//
+//   usage: asset_baker [resources directory] [--force]
+//
+// Textures referenced by the .mtl files under <resources>/objects and every image under <resources>/textures
+// (skybox faces included) are baked. Normal maps (map_Bump/bump/norm) become BC5, color images BC3 if they
+// have an alpha channel and BC1 otherwise. An image that is used both as color and as normal map is baked
+// as color. Files whose .ktx is newer than the source are skipped unless --force is given.
+#include <learnopengl/ktx_format.h>
+#include <learnopengl/thread_pool.h>
+#include <stb_image.h>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct Image {
+    int width = 0;
+    int height = 0;
+    vector<uint8_t> rgba;
+
+    const uint8_t *pixel(int x, int y) const
+    {
+        x = min(x, width - 1);
+        y = min(y, height - 1);
+        return &rgba[4 * ((size_t) y * width + x)];
+    }
+};
+
+// ------------------------------------------------------------------------
+// mip chain
+
+static Image downsample(const Image &source, bool normalMap)
+{
+    Image result;
+    result.width = max(1, source.width / 2);
+    result.height = max(1, source.height / 2);
+    result.rgba.resize(4 * (size_t) result.width * result.height);
+    for (int y = 0; y < result.height; y++) {
+        for (int x = 0; x < result.width; x++) {
+            const uint8_t *p[4] = {source.pixel(2 * x, 2 * y), source.pixel(2 * x + 1, 2 * y),
+                                   source.pixel(2 * x, 2 * y + 1), source.pixel(2 * x + 1, 2 * y + 1)};
+            uint8_t *out = &result.rgba[4 * ((size_t) y * result.width + x)];
+            if (normalMap) {
+                // average the decoded vectors and renormalize, averaging the bytes would shorten them
+                float n[3] = {0.0f, 0.0f, 0.0f};
+                for (int i = 0; i < 4; i++)
+                    for (int c = 0; c < 3; c++)
+                        n[c] += p[i][c] / 127.5f - 1.0f;
+                float length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                for (int c = 0; c < 3; c++)
+                    out[c] = (uint8_t) lround(((length > 0.0f ? n[c] / length : 0.0f) + 1.0f) * 127.5f);
+                out[3] = 255;
+            } else {
+                for (int c = 0; c < 4; c++)
+                    out[c] = (uint8_t) ((p[0][c] + p[1][c] + p[2][c] + p[3][c] + 2) / 4);
+            }
+        }
+    }
+    return result;
+}
+
+// ------------------------------------------------------------------------
+// block encoders
+
+static uint16_t to565(const float color[3])
+{
+    int r = (int) lround(min(max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f);
+    int g = (int) lround(min(max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f);
+    int b = (int) lround(min(max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f);
+    return (uint16_t) ((r << 11) | (g << 5) | b);
+}
+
+static void from565(uint16_t color, int out[3])
+{
+    int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+    out[0] = (r << 3) | (r >> 2);
+    out[1] = (g << 2) | (g >> 4);
+    out[2] = (b << 3) | (b >> 2);
+}
+
+// BC1 color block in four color mode (also the color half of BC3).
+// endpoints are the extremes of the block along its principal axis.
+static void encodeColorBlock(const uint8_t pixels[16][4], uint8_t out[8])
+{
+    float mean[3] = {0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < 3; c++)
+            mean[c] += pixels[i][c] / 16.0f;
+
+    float covariance[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}; // xx xy xz yy yz zz
+    for (int i = 0; i < 16; i++) {
+        float d[3] = {pixels[i][0] - mean[0], pixels[i][1] - mean[1], pixels[i][2] - mean[2]};
+        covariance[0] += d[0] * d[0];
+        covariance[1] += d[0] * d[1];
+        covariance[2] += d[0] * d[2];
+        covariance[3] += d[1] * d[1];
+        covariance[4] += d[1] * d[2];
+        covariance[5] += d[2] * d[2];
+    }
+    // power iteration for the dominant eigenvector
+    float axis[3] = {1.0f, 1.0f, 1.0f};
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float next[3] = {
+                covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+                covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+                covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2]};
+        float length = max(max(fabs(next[0]), fabs(next[1])), fabs(next[2]));
+        if (length < 1e-6f)
+            break;
+        for (int c = 0; c < 3; c++)
+            axis[c] = next[c] / length;
+    }
+
+    float minProjection = 1e30f, maxProjection = -1e30f;
+    for (int i = 0; i < 16; i++) {
+        float projection = 0.0f;
+        for (int c = 0; c < 3; c++)
+            projection += (pixels[i][c] - mean[c]) * axis[c];
+        minProjection = min(minProjection, projection);
+        maxProjection = max(maxProjection, projection);
+    }
+    float axisLengthSquared = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    float end0[3], end1[3];
+    for (int c = 0; c < 3; c++) {
+        end0[c] = mean[c] + axis[c] * maxProjection / axisLengthSquared;
+        end1[c] = mean[c] + axis[c] * minProjection / axisLengthSquared;
+    }
+    uint16_t color0 = to565(end0);
+    uint16_t color1 = to565(end1);
+    if (color0 < color1)
+        swap(color0, color1);
+
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        int palette[4][3];
+        from565(color0, palette[0]);
+        from565(color1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; i++) {
+            int best = 0, bestDistance = 1 << 30;
+            for (int p = 0; p < 4; p++) {
+                int distance = 0;
+                for (int c = 0; c < 3; c++)
+                    distance += (pixels[i][c] - palette[p][c]) * (pixels[i][c] - palette[p][c]);
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t) best << (2 * i);
+        }
+    }
+    out[0] = color0 & 0xFF;
+    out[1] = color0 >> 8;
+    out[2] = color1 & 0xFF;
+    out[3] = color1 >> 8;
+    for (int i = 0; i < 4; i++)
+        out[4 + i] = (indices >> (8 * i)) & 0xFF;
+}
+
+// BC4 style block for a single channel (the alpha half of BC3, each half of BC5), eight value mode
+static void encodeChannelBlock(const uint8_t values[16], uint8_t out[8])
+{
+    uint8_t high = *max_element(values, values + 16);
+    uint8_t low = *min_element(values, values + 16);
+    uint64_t indices = 0;
+    if (high != low) {
+        int palette[8] = {high, low};
+        for (int p = 1; p < 7; p++)
+            palette[p + 1] = ((7 - p) * high + p * low) / 7;
+        for (int i = 0; i < 16; i++) {
+            int best = 0, bestDistance = 1 << 30;
+            for (int p = 0; p < 8; p++) {
+                int distance = abs(values[i] - palette[p]);
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= (uint64_t) best << (3 * i);
+        }
+    }
+    out[0] = high;
+    out[1] = low;
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = (indices >> (8 * i)) & 0xFF;
+}
+
+static vector<uint8_t> compress(const Image &image, uint32_t format)
+{
+    vector<uint8_t> blocks;
+    blocks.reserve(KtxLevelBytes(format, image.width, image.height));
+    for (int by = 0; by < image.height; by += 4) {
+        for (int bx = 0; bx < image.width; bx += 4) {
+            uint8_t pixels[16][4];
+            for (int i = 0; i < 16; i++)
+                memcpy(pixels[i], image.pixel(bx + i % 4, by + i / 4), 4); // edge blocks repeat the last row/column
+
+            uint8_t block[16];
+            if (format == KTX_FORMAT_BC1) {
+                encodeColorBlock(pixels, block);
+            } else if (format == KTX_FORMAT_BC3) {
+                uint8_t alpha[16];
+                for (int i = 0; i < 16; i++)
+                    alpha[i] = pixels[i][3];
+                encodeChannelBlock(alpha, block);
+                encodeColorBlock(pixels, block + 8);
+            } else {
+                uint8_t x[16], y[16];
+                for (int i = 0; i < 16; i++) {
+                    x[i] = pixels[i][0];
+                    y[i] = pixels[i][1];
+                }
+                encodeChannelBlock(x, block);
+                encodeChannelBlock(y, block + 8);
+            }
+            blocks.insert(blocks.end(), block, block + KtxBlockBytes(format));
+        }
+    }
+    return blocks;
+}
+
+// ------------------------------------------------------------------------
+// baking a single image
+
+struct BakeResult {
+    bool ok = false;
+    size_t uncompressedBytes = 0; // RGBA8 with a full mip chain, what the runtime path used to upload
+    size_t compressedBytes = 0;
+};
+
+static BakeResult bake(const string &path, bool normalMap)
+{
+    BakeResult result;
+    Image image;
+    int components;
+    unsigned char *data = stbi_load(path.c_str(), &image.width, &image.height, &components, 4);
+    if (!data) {
+        cout << "  can't read " << path << ": " << stbi_failure_reason() << endl;
+        return result;
+    }
+    image.rgba.assign(data, data + 4 * (size_t) image.width * image.height);
+    stbi_image_free(data);
+
+    uint32_t format = KTX_FORMAT_BC1, baseFormat = KTX_BASE_RGB;
+    if (normalMap) {
+        format = KTX_FORMAT_BC5;
+        baseFormat = KTX_BASE_RG;
+    } else {
+        for (size_t i = 3; i < image.rgba.size(); i += 4) {
+            if (image.rgba[i] != 255) {
+                format = KTX_FORMAT_BC3;
+                baseFormat = KTX_BASE_RGBA;
+                break;
+            }
+        }
+    }
+
+    const int width = image.width, height = image.height;
+    vector<vector<uint8_t>> levels;
+    for (;;) {
+        levels.push_back(compress(image, format));
+        result.uncompressedBytes += image.rgba.size();
+        if (image.width == 1 && image.height == 1)
+            break;
+        image = downsample(image, normalMap);
+    }
+
+    KtxHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+    header.endianness = KTX_ENDIANNESS;
+    header.glTypeSize = 1;
+    header.glInternalFormat = format;
+    header.glBaseInternalFormat = baseFormat;
+    header.pixelWidth = width;
+    header.pixelHeight = height;
+    header.numberOfFaces = 1;
+    header.numberOfMipmapLevels = levels.size();
+
+    string output = path + ".ktx";
+    string temporary = output + ".tmp";
+    {
+        ofstream out(temporary, ios::binary | ios::trunc);
+        out.write((const char *) &header, sizeof(header));
+        for (const vector<uint8_t> &level : levels) {
+            uint32_t imageSize = level.size();
+            out.write((const char *) &imageSize, 4);
+            out.write((const char *) level.data(), level.size()); // block sizes are multiples of 4, no padding needed
+            result.compressedBytes += level.size();
+        }
+        if (!out) {
+            cout << "  can't write " << temporary << endl;
+            remove(temporary.c_str());
+            return result;
+        }
+    }
+    result.ok = rename(temporary.c_str(), output.c_str()) == 0;
+    return result;
+}
+
+// ------------------------------------------------------------------------
+// finding the textures
+
+static bool isDirectory(const string &path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static vector<string> listDirectory(const string &path)
+{
+    vector<string> entries;
+    if (DIR *dir = opendir(path.c_str())) {
+        while (dirent *entry = readdir(dir)) {
+            string name = entry->d_name;
+            if (name != "." && name != "..")
+                entries.push_back(path + "/" + name);
+        }
+        closedir(dir);
+    }
+    sort(entries.begin(), entries.end());
+    return entries;
+}
+
+static string lowercase(string text)
+{
+    transform(text.begin(), text.end(), text.begin(), ::tolower);
+    return text;
+}
+
+static bool hasExtension(const string &path, const string &extension)
+{
+    string lower = lowercase(path);
+    return lower.size() >= extension.size() && lower.compare(lower.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+static bool isImage(const string &path)
+{
+    return hasExtension(path, ".png") || hasExtension(path, ".jpg") || hasExtension(path, ".jpeg") || hasExtension(path, ".tga");
+}
+
+// image path -> true if it is only ever used as a normal map
+typedef map<string, bool> TextureSet;
+
+static void addTexture(TextureSet &textures, const string &path, bool normalMap)
+{
+    auto it = textures.find(path);
+    if (it == textures.end())
+        textures[path] = normalMap;
+    else
+        it->second = it->second && normalMap;
+}
+
+static void collectMaterialTextures(const string &mtlPath, TextureSet &textures)
+{
+    string directory = mtlPath.substr(0, mtlPath.find_last_of('/'));
+    ifstream in(mtlPath);
+    string line;
+    while (getline(in, line)) {
+        istringstream tokens(line);
+        string keyword;
+        if (!(tokens >> keyword))
+            continue;
+        keyword = lowercase(keyword);
+        bool normalMap = keyword == "map_bump" || keyword == "bump" || keyword == "norm";
+        if (keyword.compare(0, 4, "map_") != 0 && !normalMap)
+            continue;
+        // options (-bm 1.0 ...) come first, the file name is the last token
+        string file, token;
+        while (tokens >> token)
+            file = token;
+        if (!file.empty() && isImage(file))
+            addTexture(textures, directory + "/" + file, normalMap);
+    }
+}
+
+static void collectImages(const string &directory, TextureSet &textures)
+{
+    for (const string &entry : listDirectory(directory)) {
+        if (isDirectory(entry))
+            collectImages(entry, textures);
+        else if (isImage(entry))
+            addTexture(textures, entry, false);
+    }
+}
+
+static bool isUpToDate(const string &path)
+{
+    struct stat source, baked;
+    return stat(path.c_str(), &source) == 0 && stat((path + ".ktx").c_str(), &baked) == 0
+           && baked.st_mtime >= source.st_mtime;
+}
+
+int main(int argc, char **argv)
+{
+    string resources = "resources";
+    bool force = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--force") == 0)
+            force = true;
+        else
+            resources = argv[i];
+    }
+
+    TextureSet textures;
+    for (const string &objectDirectory : listDirectory(resources + "/objects")) {
+        for (const string &file : listDirectory(objectDirectory))
+            if (hasExtension(file, ".mtl"))
+                collectMaterialTextures(file, textures);
+    }
+    collectImages(resources + "/textures", textures);
+    if (textures.empty()) {
+        cout << "no textures found under " << resources << endl;
+        return 1;
+    }
+
+    mutex outputMutex;
+    atomic<int> failed(0);
+    atomic<size_t> uncompressedTotal(0), compressedTotal(0);
+    {
+        ThreadPool pool;
+        for (const auto &texture : textures) {
+            const string path = texture.first;
+            const bool normalMap = texture.second;
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0) {
+                cout << "missing: " << path << endl; // referenced by a material but not shipped, the engine reports it too
+                continue;
+            }
+            if (!force && isUpToDate(path)) {
+                cout << "up to date: " << path << endl;
+                continue;
+            }
+            pool.enqueue([&, path, normalMap] {
+                BakeResult result = bake(path, normalMap);
+                lock_guard<mutex> lock(outputMutex);
+                if (!result.ok) {
+                    failed++;
+                    return;
+                }
+                uncompressedTotal += result.uncompressedBytes;
+                compressedTotal += result.compressedBytes;
+                cout << (normalMap ? "BC5 " : "    ") << path << ": " << result.uncompressedBytes / 1024 << " KB -> "
+                     << result.compressedBytes / 1024 << " KB" << endl;
+            });
+        }
+    } // the pool finishes every job before it is destroyed
+
+    if (compressedTotal > 0)
+        cout << "baked " << uncompressedTotal / (1024 * 1024) << " MB of RGBA mip chains into "
+             << compressedTotal / (1024 * 1024) << " MB (" << (double) uncompressedTotal / compressedTotal << "x)" << endl;
+    return failed > 0 ? 1 : 0;
+}
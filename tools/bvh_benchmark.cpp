@@ -0,0 +1,182 @@
+// bvh_benchmark: times the queries of learnopengl/bvh.h against a loop over every object.
+//
+//   usage: bvh_benchmark [query count]
+//
+// For 1k, 10k and 100k random boxes scattered through a cube it builds the tree, refits it after moving
+// 1% of the objects, and runs frustum, ray and sphere queries both ways. Every BVH answer is checked against
+// the brute force one, a mismatch is reported and makes the program exit with 1.
+#include <learnopengl/bvh.h>
+#include <learnopengl/frustum.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static double millisecondsSince(Clock::time_point start)
+{
+    return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+struct Ray {
+    glm::vec3 origin;
+    glm::vec3 direction;
+};
+
+struct Sphere {
+    glm::vec3 center;
+    float radius;
+};
+
+static Aabb randomBox(mt19937 &random, float worldSize)
+{
+    uniform_real_distribution<float> position(-worldSize * 0.5f, worldSize * 0.5f);
+    uniform_real_distribution<float> size(0.5f, 5.0f);
+    glm::vec3 center(position(random), position(random), position(random));
+    glm::vec3 extent(size(random), size(random), size(random));
+    return Aabb(center - extent * 0.5f, center + extent * 0.5f);
+}
+
+static glm::vec3 randomDirection(mt19937 &random)
+{
+    uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    glm::vec3 direction;
+    do {
+        direction = glm::vec3(unit(random), unit(random), unit(random));
+    } while (glm::dot(direction, direction) < 0.01f || glm::dot(direction, direction) > 1.0f);
+    return glm::normalize(direction);
+}
+
+static bool run(size_t objectCount, size_t queryCount)
+{
+    const float worldSize = 1000.0f;
+    mt19937 random(objectCount);
+    uniform_real_distribution<float> position(-worldSize * 0.5f, worldSize * 0.5f);
+
+    vector<Aabb> boxes(objectCount);
+    for (Aabb &box : boxes)
+        box = randomBox(random, worldSize);
+
+    Bvh bvh;
+    Clock::time_point start = Clock::now();
+    bvh.Build(boxes);
+    double buildTime = millisecondsSince(start);
+
+    // move 1% of the objects a little, like a few ships flying around
+    start = Clock::now();
+    for (size_t i = 0; i < objectCount / 100; i++) {
+        size_t object = random() % objectCount;
+        glm::vec3 offset = randomDirection(random) * 2.0f;
+        boxes[object] = Aabb(boxes[object].min + offset, boxes[object].max + offset);
+        bvh.Update(object, boxes[object]);
+    }
+    double refitTime = millisecondsSince(start);
+
+    vector<Frustum> frustums;
+    vector<Ray> rays;
+    vector<Sphere> spheres;
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 300.0f);
+    for (size_t i = 0; i < queryCount; i++) {
+        glm::vec3 eye(position(random), position(random), position(random));
+        glm::vec3 direction = randomDirection(random);
+        glm::vec3 up = fabs(direction.y) > 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        frustums.push_back(Frustum(projection * glm::lookAt(eye, eye + direction, up)));
+        rays.push_back({eye, direction});
+        spheres.push_back({eye, 20.0f});
+    }
+
+    bool correct = true;
+    size_t bruteCount = 0, bvhCount = 0;
+
+    // frustum: both sides report what BoxVisible accepts
+    start = Clock::now();
+    for (const Frustum &frustum : frustums)
+        for (const Aabb &box : boxes)
+            bruteCount += frustum.BoxVisible(box.min, box.max);
+    double frustumBrute = millisecondsSince(start);
+    start = Clock::now();
+    for (const Frustum &frustum : frustums)
+        bvh.QueryFrustum(frustum, [&](uint32_t, bool) { bvhCount++; });
+    double frustumBvh = millisecondsSince(start);
+    if (bruteCount != bvhCount) {
+        printf("frustum mismatch: %zu brute force, %zu bvh\n", bruteCount, bvhCount);
+        correct = false;
+    }
+
+    // ray: nearest box
+    vector<float> bruteDistances;
+    start = Clock::now();
+    for (const Ray &ray : rays) {
+        glm::vec3 inverse = glm::vec3(1.0f) / ray.direction;
+        float nearest = FLT_MAX;
+        for (const Aabb &box : boxes) {
+            float distance = Bvh::rayBox(box, ray.origin, inverse, nearest);
+            if (distance >= 0.0f && distance < nearest)
+                nearest = distance;
+        }
+        bruteDistances.push_back(nearest);
+    }
+    double rayBrute = millisecondsSince(start);
+    vector<float> bvhDistances;
+    start = Clock::now();
+    for (const Ray &ray : rays) {
+        Bvh::RayHit hit;
+        bvh.Raycast(ray.origin, ray.direction, FLT_MAX, hit);
+        bvhDistances.push_back(hit.distance);
+    }
+    double rayBvh = millisecondsSince(start);
+    for (size_t i = 0; i < rays.size(); i++) {
+        if (bruteDistances[i] != bvhDistances[i]) {
+            printf("ray %zu mismatch: %g brute force, %g bvh\n", i, bruteDistances[i], bvhDistances[i]);
+            correct = false;
+            break;
+        }
+    }
+
+    // sphere: everything within the radius
+    bruteCount = bvhCount = 0;
+    start = Clock::now();
+    for (const Sphere &sphere : spheres) {
+        for (const Aabb &box : boxes) {
+            glm::vec3 offset = glm::max(glm::max(box.min - sphere.center, sphere.center - box.max), glm::vec3(0.0f));
+            bruteCount += glm::dot(offset, offset) <= sphere.radius * sphere.radius;
+        }
+    }
+    double sphereBrute = millisecondsSince(start);
+    start = Clock::now();
+    for (const Sphere &sphere : spheres)
+        bvh.QuerySphere(sphere.center, sphere.radius, [&](uint32_t) { bvhCount++; });
+    double sphereBvh = millisecondsSince(start);
+    if (bruteCount != bvhCount) {
+        printf("sphere mismatch: %zu brute force, %zu bvh\n", bruteCount, bvhCount);
+        correct = false;
+    }
+
+    double perQuery = 1000.0 / queryCount; // ms for all queries -> us per query
+    printf("%7zu objects, %6zu nodes: build %.2f ms, refit %zu objects %.3f ms\n",
+           objectCount, bvh.NodeCount(), buildTime, objectCount / 100, refitTime);
+    printf("    frustum  brute force %9.2f us  bvh %8.2f us  (%.1fx)\n", frustumBrute * perQuery, frustumBvh * perQuery, frustumBrute / frustumBvh);
+    printf("    ray      brute force %9.2f us  bvh %8.2f us  (%.1fx)\n", rayBrute * perQuery, rayBvh * perQuery, rayBrute / rayBvh);
+    printf("    sphere   brute force %9.2f us  bvh %8.2f us  (%.1fx)\n", sphereBrute * perQuery, sphereBvh * perQuery, sphereBrute / sphereBvh);
+    return correct;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t queryCount = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200;
+    if (queryCount == 0)
+        queryCount = 200;
+    bool correct = true;
+    for (size_t objectCount : {1000, 10000, 100000})
+        correct = run(objectCount, queryCount) && correct;
+    return correct ? 0 : 1;
+}